@@ -0,0 +1,144 @@
+// Benchmark of the boundary face extraction of tet_mesh_boundary against the sort based matcher it replaced in
+// tet_mesh_faces. Both run on a regular grid of cubes split into 6 tets each, which is about 10M tets by default.
+//
+// Usage: benchmark_tet_boundary [cubes_per_side]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "utils/tet_mesh_topology.h"
+
+
+// The boundary extraction tet_mesh_faces used before tet_mesh_boundary, kept as it was for comparison
+static void sort_tet_mesh_faces(const Eigen::MatrixXi& TT, Eigen::MatrixXi& TF, bool flip) {
+    using namespace std;
+
+    vector<array<int, 4>> tris_sorted;
+
+    vector<array<int, 4>> tris;
+    for (int i = 0; i < TT.rows(); i++) {
+        const int e1 = TT(i, 0);
+        const int e2 = TT(i, 1);
+        const int e3 = TT(i, 2);
+        const int e4 = TT(i, 3);
+        array<int, 4> t1, t2, t3, t4;
+        if (!flip) {
+            t1 = array<int, 4>{{ e1, e2, e3, INT_MAX }};
+            t2 = array<int, 4>{{ e1, e3, e4, INT_MAX }};
+            t3 = array<int, 4>{{ e2, e4, e3, INT_MAX }};
+            t4 = array<int, 4>{{ e1, e4, e2, INT_MAX }};
+        } else {
+            t1 = array<int, 4>{{ e1, e3, e2, INT_MAX }};
+            t2 = array<int, 4>{{ e1, e4, e3, INT_MAX }};
+            t3 = array<int, 4>{{ e2, e3, e4, INT_MAX }};
+            t4 = array<int, 4>{{ e1, e2, e4, INT_MAX }};
+        }
+        tris.push_back(t1);
+        tris.push_back(t2);
+        tris.push_back(t3);
+        tris.push_back(t4);
+        t1[3] = tris_sorted.size();
+        t2[3] = tris_sorted.size()+1;
+        t3[3] = tris_sorted.size()+2;
+        t4[3] = tris_sorted.size()+3;
+        sort(t1.begin(), t1.end());
+        sort(t2.begin(), t2.end());
+        sort(t3.begin(), t3.end());
+        sort(t4.begin(), t4.end());
+        tris_sorted.push_back(t1);
+        tris_sorted.push_back(t2);
+        tris_sorted.push_back(t3);
+        tris_sorted.push_back(t4);
+    }
+
+    int fcount = 0;
+    TF.resize(tris_sorted.size(), 3);
+    sort(tris_sorted.begin(), tris_sorted.end());
+    for (int i = 0; i < TF.rows();) {
+        int v1 = tris_sorted[i][0], v2 = tris_sorted[i][1], v3 = tris_sorted[i][2];
+        int tid = tris_sorted[i][3];
+        int count = 0;
+        while (i < TF.rows() && v1 == tris_sorted[i][0] && v2 == tris_sorted[i][1] && v3 == tris_sorted[i][2]) {
+            i += 1;
+            count += 1;
+        }
+        if (count == 1) {
+            TF.row(fcount++) = Eigen::RowVector3i(tris[tid][0], tris[tid][1], tris[tid][2]);
+        }
+    }
+
+    TF.conservativeResize(fcount, 3);
+}
+
+
+// Split each of the n^3 unit cubes of a grid into the 6 tets around its main diagonal
+static void grid_tets(int n, Eigen::MatrixXi& TT) {
+    const int m = n + 1;
+    auto vertex = [m](int x, int y, int z) { return x + m*(y + m*z); };
+
+    // Corners of the cube visited by the 6 monotone paths from (0, 0, 0) to (1, 1, 1)
+    const int paths[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+
+    TT.resize(6*n*n*n, 4);
+    int t = 0;
+    for (int z = 0; z < n; z++) {
+        for (int y = 0; y < n; y++) {
+            for (int x = 0; x < n; x++) {
+                for (int p = 0; p < 6; p++) {
+                    int c[3] = {x, y, z};
+                    TT(t, 0) = vertex(c[0], c[1], c[2]);
+                    for (int k = 0; k < 3; k++) {
+                        c[paths[p][k]] += 1;
+                        TT(t, k + 1) = vertex(c[0], c[1], c[2]);
+                    }
+                    t += 1;
+                }
+            }
+        }
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    using clock = std::chrono::high_resolution_clock;
+
+    std::shared_ptr<spdlog::logger> logger = spdlog::stdout_color_mt("Benchmark Tet Boundary");
+    logger->set_level(spdlog::level::info);
+
+    if (argc > 2) {
+        logger->error("Usage: {} [cubes_per_side]", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const int n = argc == 2 ? std::atoi(argv[1]) : 119;
+    if (n <= 0) {
+        logger->error("Invalid grid size {}", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    Eigen::MatrixXi TT;
+    grid_tets(n, TT);
+    const int num_vertices = (n + 1)*(n + 1)*(n + 1);
+    logger->info("Grid of {}^3 cubes with {} tets and {} vertices. The boundary has {} faces.",
+                 n, TT.rows(), num_vertices, 12*n*n);
+
+    Eigen::MatrixXi TF;
+    auto start_time = clock::now();
+    sort_tet_mesh_faces(TT, TF, false);
+    const double sort_seconds = std::chrono::duration<double>(clock::now() - start_time).count();
+    logger->info("Sort based matcher: {} boundary faces in {:.3f}s", TF.rows(), sort_seconds);
+    TF.resize(0, 0);
+
+    start_time = clock::now();
+    tet_mesh_boundary(TT, num_vertices, TF, false);
+    const double boundary_seconds = std::chrono::duration<double>(clock::now() - start_time).count();
+    logger->info("tet_mesh_boundary: {} boundary faces in {:.3f}s", TF.rows(), boundary_seconds);
+
+    logger->info("Speedup: {:.2f}x", sort_seconds / boundary_seconds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+// Headless exporter for the straightened volume of a saved project. This reads only the input volume and bounding cage
+// of the project and resamples the full resolution volume along the cage on the CPU, so it runs on machines without a
+// display or GL context, and writes the same .raw/.dat pair as the Save button of the bounding cage editor.
+//
+// Usage: export_straightened <project.fish.pro> <output_name> [width height depth]
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "utils/datfile.h"
+#include "utils/path_utils.h"
+#include "utils/project_file.h"
+#include "utils/straighten_volume.h"
+#include "utils/utils.h"
+
+
+int main(int argc, char* argv[]) {
+    std::shared_ptr<spdlog::logger> logger = spdlog::stdout_color_mt("Export Straightened");
+    logger->set_level(spdlog::level::info);
+
+    if (argc != 3 && argc != 6) {
+        logger->error("Usage: {} <project.fish.pro> <output_name> [width height depth]", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ProjectCage project;
+    project.cage.set_logger(logger);
+    if (!igl::deserialize(project, "state", std::string(argv[1]))) {
+        logger->error("Failed to load project file {}", argv[1]);
+        return EXIT_FAILURE;
+    }
+    const BoundingCage& cage = project.cage;
+    ImageInput& input_metadata = project.input_metadata;
+    if (cage.num_keyframes() < 2) {
+        logger->error("Project {} does not have a bounding cage", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // Load the volumes relative to the project file like the UI does
+    input_metadata.output_dir = dir_and_base_name(argv[1]).first;
+    const DatFile low_res_datfile(input_metadata.low_res_path_prefx() + ".dat", logger);
+    const DatFile hi_res_datfile(input_metadata.full_res_path_prefix() + ".dat", logger);
+    const Eigen::RowVector3i low_res_dims(low_res_datfile.w, low_res_datfile.h, low_res_datfile.d);
+    const Eigen::RowVector3i hi_res_dims(hi_res_datfile.w, hi_res_datfile.h, hi_res_datfile.d);
+
+    std::vector<uint8_t> hi_res_data;
+    if (!load_rawfile(input_metadata.full_res_path_prefix() + ".raw", hi_res_dims, hi_res_data, logger)) {
+        logger->error("Failed to load full resolution volume {}.raw", input_metadata.full_res_path_prefix());
+        return EXIT_FAILURE;
+    }
+
+    int output_dims[3];
+    if (argc == 6) {
+        for (int i = 0; i < 3; i++) {
+            output_dims[i] = std::atoi(argv[3 + i]);
+        }
+    } else {
+        // Same default dimensions as the save dialog
+        Eigen::Vector4d kfbb = cage.keyframe_bounding_box();
+        output_dims[0] = int((kfbb[1] - kfbb[0])*input_metadata.downsample_factor);
+        output_dims[1] = int((kfbb[3] - kfbb[2])*input_metadata.downsample_factor);
+        output_dims[2] = int(cage.cage_length()*input_metadata.downsample_factor);
+    }
+    if (output_dims[0] <= 0 || output_dims[1] <= 0 || output_dims[2] <= 0) {
+        logger->error("Invalid output dimensions {} x {} x {}", output_dims[0], output_dims[1], output_dims[2]);
+        return EXIT_FAILURE;
+    }
+
+    const std::string save_file_name = std::string(argv[2]);
+    const std::string save_datfile_path = input_metadata.output_dir + "/" + save_file_name + ".dat";
+    const std::string save_rawfile_path = input_metadata.output_dir + "/" + save_file_name + ".raw";
+
+    logger->info("Exporting {} x {} x {} straightened volume to {}",
+                 output_dims[0], output_dims[1], output_dims[2], save_rawfile_path);
+    if (!write_straightened_volume(cage, hi_res_data, hi_res_dims, low_res_dims,
+                                   output_dims[0], output_dims[1], output_dims[2], save_rawfile_path, logger)) {
+        return EXIT_FAILURE;
+    }
+
+    DatFile out_datfile;
+    out_datfile.w = output_dims[0];
+    out_datfile.h = output_dims[1];
+    out_datfile.d = output_dims[2];
+    out_datfile.m_raw_filename = save_file_name + ".raw";
+    out_datfile.m_format = "UINT8";
+    out_datfile.serialize(save_datfile_path, logger);
+
+    return EXIT_SUCCESS;
+}
@@ -86,6 +86,9 @@ bool Bounding_Polygon_Menu::mouse_down(int button, int modifier) {
 bool Bounding_Polygon_Menu::mouse_up(int button, int modifier) {
     bool ret = FishUIViewerPlugin::mouse_up(button, modifier);
     ret = ret || widget_2d.mouse_up(button, modifier, is_2d_widget_in_focus());
+
+    // Dragging in the 2D widget edits the cage on every mouse move, so the whole drag becomes one undo step
+    state.cage.snapshot();
     return ret;
 }
 
@@ -98,6 +101,23 @@ bool Bounding_Polygon_Menu::mouse_scroll(float delta_y) {
 
 bool Bounding_Polygon_Menu::key_down(int button, int modifier) {
     bool ret = FishUIViewerPlugin::key_down(button, modifier);
+
+    // Ctrl+Z undoes the last cage edit, Ctrl+Y or Ctrl+Shift+Z redoes it
+    if (!ret && (modifier & GLFW_MOD_CONTROL) && (button == GLFW_KEY_Z || button == GLFW_KEY_Y)) {
+        const bool redo = button == GLFW_KEY_Y || (modifier & GLFW_MOD_SHIFT);
+        if (redo) {
+            state.cage.redo();
+        } else {
+            state.cage.undo();
+        }
+
+        // A failed undo or redo drops the history, so refresh either way
+        widget_2d.clear_selection();
+        glfwPostEmptyEvent();
+        cage_dirty = true;
+        return true;
+    }
+
     ret = ret || widget_2d.key_down(button, modifier, is_2d_widget_in_focus());
     return ret;
 }
@@ -160,10 +180,7 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
     }
 
     auto reset_dims = [&]() {
-        double d = -1.0;
-        std::vector<double> kf_depths;
-        state.cage.keyframe_depths(kf_depths);
-        d = kf_depths.back();
+        double d = state.cage.cage_length();
 
         Eigen::Vector4d kfbb = state.cage.keyframe_bounding_box();
         double w = kfbb[1] - kfbb[0];
@@ -191,9 +208,7 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
         }
 
         if (output_preserve_aspect_ratio) {
-            std::vector<double> kf_depths;
-            state.cage.keyframe_depths(kf_depths);
-            double d = kf_depths.back();
+            double d = state.cage.cage_length();
 
             Eigen::RowVector4d kfbb = state.cage.keyframe_bounding_box();
             double w = std::max(round(fabs(kfbb[1] - kfbb[0])), 1.0);
@@ -238,6 +253,32 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
     if (ImGui::Button("Reset Dims")) {
         reset_dims();
     }
+
+    GLint max_texture_size;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_texture_size);
+    const bool output_exceeds_texture =
+            std::max(output_dims[0], std::max(output_dims[1], output_dims[2])) > max_texture_size;
+    if (output_exceeds_texture) {
+        ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
+        ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f);
+    }
+    bool tiled = output_tiled || output_exceeds_texture;
+    if (ImGui::Checkbox("Tiled Export", &tiled)) {
+        output_tiled = tiled;
+    }
+    if (output_exceeds_texture) {
+        ImGui::PopItemFlag();
+        ImGui::PopStyleVar();
+    }
+    if (tiled) {
+        ImGui::Text("Brick Budget (MB):");
+        ImGui::SameLine();
+        ImGui::PushItemWidth(-1);
+        if (ImGui::InputInt("##BrickBudget", &output_brick_budget_mb)) {
+            output_brick_budget_mb = std::max(output_brick_budget_mb, 1);
+        }
+        ImGui::PopItemWidth();
+    }
     if (std::string(save_name_buf).size() == 0) {
         disabled = true;
     }
@@ -245,6 +286,9 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
     if (!save_name_invalid && !save_name_overwrite) {
         ImGui::NewLine();
     }
+    if (!save_export_error_message.empty()) {
+        ImGui::TextColored(ImColor(200, 20, 20, 255), "%s", save_export_error_message.c_str());
+    }
 
     ImGui::Separator();
 
@@ -261,14 +305,8 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
         state.input_metadata.project_name = save_file_name;
 
         igl::serialize(state, "state", save_project_path, true);
-        DatFile out_datfile;
-        out_datfile.w = output_dims[0];
-        out_datfile.h = output_dims[1];
-        out_datfile.d = output_dims[2];
-        out_datfile.m_raw_filename = save_file_name + ".raw";
-        out_datfile.m_format = "UINT8";
-        out_datfile.serialize(save_datfile_path, state.logger);
 
+        bool exported = false;
         {
             glBindTexture(GL_TEXTURE_3D, state.hi_res_volume.volume_texture);
             GLint old_min_filter, old_mag_filter;
@@ -277,9 +315,17 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
             glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glBindTexture(GL_TEXTURE_3D, 0);
-            exporter.set_export_dims(output_dims[0], output_dims[1], output_dims[2]);
-            exporter.update(state.cage, state.hi_res_volume.volume_texture, G3f(state.low_res_volume.dims()));
-            exporter.write_texture_data_to_file(save_rawfile_path);
+            if (tiled) {
+                // Bricks sample regions read from the full resolution file, so the whole volume is never on the GPU
+                exported = exporter.write_tiled(state.cage, state.input_metadata.full_res_path_prefix() + ".raw",
+                                                state.hi_res_volume.dims(), state.low_res_volume.dims(),
+                                                glm::ivec3(output_dims[0], output_dims[1], output_dims[2]),
+                                                size_t(output_brick_budget_mb) << 20, save_rawfile_path, state.logger);
+            } else {
+                exporter.set_export_dims(output_dims[0], output_dims[1], output_dims[2]);
+                exporter.update(state.cage, state.hi_res_volume.volume_texture, G3f(state.low_res_volume.dims()));
+                exported = exporter.write_texture_data_to_file(save_rawfile_path, state.logger);
+            }
             cage_dirty = true;
             glBindTexture(GL_TEXTURE_3D, state.hi_res_volume.volume_texture);
             glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, old_min_filter);
@@ -287,10 +333,24 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
             glBindTexture(GL_TEXTURE_3D, 0);
         }
 
-        show_save_popup = false;
-        output_dims[0] = -1;
-        output_dims[1] = -1;
-        output_dims[2] = -2;
+        // Only describe the .raw file once it is complete, so a failed export never leaves a .dat pointing at it
+        if (exported) {
+            DatFile out_datfile;
+            out_datfile.w = output_dims[0];
+            out_datfile.h = output_dims[1];
+            out_datfile.d = output_dims[2];
+            out_datfile.m_raw_filename = save_file_name + ".raw";
+            out_datfile.m_format = "UINT8";
+            out_datfile.serialize(save_datfile_path, state.logger);
+
+            save_export_error_message = "";
+            show_save_popup = false;
+            output_dims[0] = -1;
+            output_dims[1] = -1;
+            output_dims[2] = -2;
+        } else {
+            save_export_error_message = "Error: Failed to write " + save_rawfile_path + ". See the log for details.";
+        }
     }
     if (disabled) {
         ImGui::PopItemFlag();
@@ -298,6 +358,7 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
     }
     ImGui::SameLine();
     if (ImGui::Button("Cancel")) {
+        save_export_error_message = "";
         show_save_popup = false;
         output_dims[0] = -1;
         output_dims[1] = -1;
@@ -308,12 +369,7 @@ void Bounding_Polygon_Menu::post_draw_save(int window_width) {
 
 bool Bounding_Polygon_Menu::post_draw() {
     if (cage_dirty) {
-        double depth = 0, width, height;
-        Eigen::RowVector3d last_centroid = state.cage.keyframes.begin()->centroid_3d();
-        for (const BoundingCage::KeyFrame& kf : state.cage.keyframes) {
-            depth += (kf.centroid_3d() - last_centroid).norm();
-            last_centroid = kf.centroid_3d();
-        }
+        double depth = state.cage.cage_length(), width, height;
         depth = round(depth) * widget_3d.export_rescale_factor;
 
         Eigen::RowVector4d cage_bbox = state.cage.keyframe_bounding_box();
@@ -355,10 +411,15 @@ bool Bounding_Polygon_Menu::post_draw() {
     Eigen::Vector4f widget_3d_viewport(view_hsplit*window_width, view_vsplit*window_height,
                                        (1.0-view_hsplit)*window_width, (1.0-view_vsplit)*window_height);
     viewer->core.viewport = widget_3d_viewport;
+
+    // The 3D view only draws the cross section at the cut, so it does not need a KeyFrame.
+    // current_cut_index is clamped to the cage, so the Frame always exists.
+    BoundingCage::Frame current_frame;
+    state.cage.frame_for_index(current_cut_index, current_frame);
     if (draw_straight) {
-        ret = widget_3d.post_draw_straight(G4f(widget_3d_viewport), state.cage.keyframe_for_index(current_cut_index));
+        ret = widget_3d.post_draw_straight(G4f(widget_3d_viewport), current_frame);
     } else {
-        ret = widget_3d.post_draw_curved(G4f(widget_3d_viewport), state.cage.keyframe_for_index(current_cut_index));
+        ret = widget_3d.post_draw_curved(G4f(widget_3d_viewport), current_frame);
     }
 
 
@@ -431,20 +492,28 @@ bool Bounding_Polygon_Menu::post_draw() {
 
     if (ImGui::InputFloat("Nudge Amount", &keyframe_nudge_amount, 0.01, 0.1, 5)) {}
 
-    BoundingCage::KeyFrameIterator kf = state.cage.keyframe_for_index(current_cut_index);
+    BoundingCage::KeyFrameIterator kf = state.cage.keyframe_for_index(current_cut_index).pinned();
     if (ImGui::Button("Insert KF")) {
         state.cage.insert_keyframe(current_cut_index);
+        state.cage.snapshot();
         glfwPostEmptyEvent();
         cage_dirty = true;
     }
     ImGui::SameLine();
     if (ImGui::Button("Remove KF")) {
         BoundingCage::KeyFrameIterator it = state.cage.keyframe_for_index(current_cut_index);
+        BoundingCage::KeyFrameIterator next = it;
+        if (it.in_bounding_cage()) {
+            next++;
+        }
 
-        state.cage.delete_keyframe(it);
-        BoundingCage::KeyFrameIterator next = it++;
-        if (next != state.cage.keyframes.end()) {
-            current_cut_index = next->index();
+        if (state.cage.delete_keyframe(it)) {
+            state.cage.snapshot();
+            if (next != state.cage.keyframes.end()) {
+                current_cut_index = next->index();
+            }
+            widget_2d.clear_selection();
+            kf = state.cage.keyframe_for_index(current_cut_index).pinned();
         }
         glfwPostEmptyEvent();
         cage_dirty = true;
@@ -453,10 +522,27 @@ bool Bounding_Polygon_Menu::post_draw() {
     if (ImGui::Button("Reset Rotation")) {
         if (kf->in_bounding_cage()) {
             kf->set_angle(0.0);
+            state.cage.snapshot();
         }
         glfwPostEmptyEvent();
         cage_dirty = true;
     }
+    ImGui::SameLine();
+    if (ImGui::Button("Undo")) {
+        state.cage.undo();
+        widget_2d.clear_selection();
+        kf = state.cage.keyframe_for_index(current_cut_index).pinned();
+        glfwPostEmptyEvent();
+        cage_dirty = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Redo")) {
+        state.cage.redo();
+        widget_2d.clear_selection();
+        kf = state.cage.keyframe_for_index(current_cut_index).pinned();
+        glfwPostEmptyEvent();
+        cage_dirty = true;
+    }
 
     ImGui::Separator();
     ImGui::Text("Display Options");
@@ -523,6 +609,7 @@ bool Bounding_Polygon_Menu::post_draw() {
             state.cage.insert_keyframe(kf);
         }
         kf->rotate_about_right(-3.14159*1.0/180.0);
+        state.cage.snapshot();
     }
     ImGui::SameLine();
     if (ImGui::Button("NR+")) {
@@ -530,12 +617,14 @@ bool Bounding_Polygon_Menu::post_draw() {
             state.cage.insert_keyframe(kf);
         }
         kf->rotate_about_right(3.14159*1.0/180.0);
+        state.cage.snapshot();
     }
     if (ImGui::Button("NU-")) {
         if (!kf->in_bounding_cage()) {
             state.cage.insert_keyframe(kf);
         }
         kf->rotate_about_up(-3.14159*1.0/180.0);
+        state.cage.snapshot();
     }
     ImGui::SameLine();
     if (ImGui::Button("NU+")) {
@@ -543,6 +632,7 @@ bool Bounding_Polygon_Menu::post_draw() {
             state.cage.insert_keyframe(kf);
         }
         kf->rotate_about_up(3.14159*1.0/180.0);
+        state.cage.snapshot();
     }
 
     ImGui::NewLine();
@@ -67,8 +67,17 @@ private:
     bool save_name_invalid = false;
     bool save_name_overwrite = false;
     std::string save_name_error_message;
+
+    // Set when writing the straightened volume failed, so the popup stays open and shows it
+    std::string save_export_error_message;
+
     int output_dims[3] = {-1, -1, -1};
     bool output_preserve_aspect_ratio = true;
+
+    // Export in bricks of at most output_brick_budget_mb MB instead of one texture. This is forced when the output
+    // does not fit in a 3D texture.
+    bool output_tiled = false;
+    int output_brick_budget_mb = 256;
 };
 
 #endif // __FISH_DEFORMATION_BOUNDING_POLYGON_STATE__
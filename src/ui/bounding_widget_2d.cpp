@@ -171,7 +171,21 @@ bool Bounding_Polygon_Widget::is_point_in_widget(glm::ivec2 p) const {
     return p_tx.x >= ll.x && p_tx.x <= ur.x && p_tx.y >= ll.y && p_tx.y <= ur.y;
 }
 
+void Bounding_Polygon_Widget::clear_selection() {
+    selection.matched_center = false;
+    selection.matched_vertex = false;
+    selection.closest_vertex_index = NoElement;
+    selection.current_edit_element = NoElement;
+    selection.current_active_keyframe = BoundingCage::KeyFrameIterator();
+}
+
 void Bounding_Polygon_Widget::update_selection() {
+    if (!has_selection()) {
+        selection.matched_center = false;
+        selection.matched_vertex = false;
+        return;
+    }
+
     // Helper function to find the closest vertex in vertices to p
     auto closest_vertex = [](const glm::vec2& p, const Eigen::MatrixXd& vertices) -> std::pair<int, float> {
         float min_dist = std::numeric_limits<float>::max();
@@ -323,6 +337,11 @@ bool Bounding_Polygon_Widget::mouse_move(int mouse_x, int mouse_y, bool in_focus
         return true;
     }
 
+    // Nothing to edit until the next post_draw() selects a KeyFrame
+    if (!has_selection()) {
+        return true;
+    }
+
     if (mouse_state.is_left_button_down && mouse_state.is_rotate_modifier_down) {
         BoundingCage::KeyFrameIterator kf = selection.current_active_keyframe;
 
@@ -399,7 +418,7 @@ bool Bounding_Polygon_Widget::mouse_move(int mouse_x, int mouse_y, bool in_focus
         mouse_state.down_position = current_mouse;
 
         if (!selection.current_active_keyframe->in_bounding_cage()) {
-            selection.current_active_keyframe = state.cage.insert_keyframe(selection.current_active_keyframe);
+            selection.current_active_keyframe = state.cage.insert_keyframe(selection.current_active_keyframe).pinned();
         }
 
         glm::vec2 kf_mouse = convert_position_mainwindow_to_keyframe(current_mouse);
@@ -437,7 +456,7 @@ bool Bounding_Polygon_Widget::mouse_down(int button, int modifier, bool in_focus
             selection.current_edit_element = CenterElement;
         }
 
-        if (left_mouse && mouse_state.is_rotate_modifier_down) {
+        if (left_mouse && mouse_state.is_rotate_modifier_down && has_selection()) {
             mouse_state.down_angle = selection.current_active_keyframe->angle();
         }
     }
@@ -542,7 +561,8 @@ bool Bounding_Polygon_Widget::post_draw(BoundingCage::KeyFrameIterator kf, bool
         }
     };
 
-    selection.current_active_keyframe = kf;
+    // The selection outlives this frame, so it keeps the KeyFrame alive until the next post_draw()
+    selection.current_active_keyframe = kf.pinned();
 
 
     GLint old_viewport[4];
@@ -27,6 +27,10 @@ public:
 
     bool post_draw(BoundingCage::KeyFrameIterator it, bool in_focus);
 
+    // Drop the selected KeyFrame and any edit in progress. Call this whenever the cage removes KeyFrames,
+    // e.g. on delete, undo or redo. The next post_draw() selects the KeyFrame at the current cut again.
+    void clear_selection();
+
 
     glm::vec2 position = { 0.f, 0.f }; // window coordinates in pixels lower left of window
     glm::vec2 size = { 500.f, 500.f }; // window coordinates in pixels
@@ -56,6 +60,7 @@ private:
     glm::vec2 convert_position_keyframe_to_ndc(const glm::vec2& p) const;
 
     void update_selection();
+    bool has_selection() const { return selection.current_active_keyframe != BoundingCage::KeyFrameIterator(); }
 
     State& state;
     igl::opengl::glfw::Viewer* viewer;
@@ -100,7 +100,7 @@ void Bounding_Widget_3d::update_volume_geometry(const Eigen::RowVector3d& volume
     volume_renderer.set_bounding_geometry((GLfloat*)V.data(), num_vertices, (GLint*)F.data(), num_faces);
 }
 
-void Bounding_Widget_3d::update_2d_geometry_curved(BoundingCage::KeyFrameIterator current_kf) {
+void Bounding_Widget_3d::update_2d_geometry_curved(const BoundingCage::Frame& current_frame) {
     typedef Eigen::Matrix<GLfloat, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixXfRm;
     const Eigen::RowVector3f volume_size = _state.low_res_volume.dims().cast<float>();
 
@@ -131,7 +131,7 @@ void Bounding_Widget_3d::update_2d_geometry_curved(BoundingCage::KeyFrameIterato
     cage_style.point_size = 4.0f;
     renderer_2d.update_polyline_3d(cage_polyline_id, cageV.data(),cage_color, num_vertices, cage_style);
 
-    MatrixXfRm kfV = current_kf->bounding_box_vertices_3d().cast<GLfloat>();
+    MatrixXfRm kfV = current_frame.bounding_box_vertices_3d.cast<GLfloat>();
     kfV.array().rowwise() /= volume_size.array();
     glm::vec4 kf_color(0.2, 0.8, 0.2, 0.3);
     PointLineRenderer::PolylineStyle kf_style;
@@ -154,25 +154,26 @@ void Bounding_Widget_3d::update_2d_geometry_curved(BoundingCage::KeyFrameIterato
     renderer_2d.update_polyline_3d(skeleton_polyline_id, skV.data(), sk_color, skV.rows(), sk_style);
 }
 
-void Bounding_Widget_3d::update_2d_geometry_straight(BoundingCage::KeyFrameIterator current_kf) {
+void Bounding_Widget_3d::update_2d_geometry_straight(const BoundingCage::Frame& current_frame) {
     typedef Eigen::Matrix<GLfloat, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixXfRm;
 
     std::vector<GLfloat> cageV;
     int num_vertices = 0;
 
-    std::vector<double> kf_lengths;
-    _state.cage.keyframe_depths(kf_lengths);
+    const std::vector<double>& kf_lengths = _state.cage.keyframe_depths();
 
-    BoundingCage::KeyFrameIterator prev_kf = current_kf;
-    if (prev_kf != _state.cage.keyframes.begin()) { prev_kf--; }
+    // The last KeyFrame before the current frame, or the first KeyFrame if the frame is at the start of the cage
+    BoundingCage::KeyFrameIterator prev_kf = _state.cage.keyframes.begin();
     int prev_kf_id = 0;
-    for (BoundingCage::KeyFrameIterator kf = _state.cage.keyframes.begin(); kf != _state.cage.keyframes.end(); kf++) {
-        if (kf == prev_kf) {
+    int kf_id = 0;
+    for (BoundingCage::KeyFrameIterator kf = _state.cage.keyframes.begin(); kf != _state.cage.keyframes.end(); kf++, kf_id++) {
+        if (kf->index() >= current_frame.index) {
             break;
         }
-        prev_kf_id += 1;
+        prev_kf = kf;
+        prev_kf_id = kf_id;
     }
-    double current_kf_length = kf_lengths[prev_kf_id] + (prev_kf->centroid_3d() - current_kf->centroid_3d()).norm();
+    double current_kf_length = kf_lengths[prev_kf_id] + (prev_kf->centroid_3d() - current_frame.centroid_3d).norm();
     double current_kf_length_normalized = current_kf_length / kf_lengths.back();
 
     for (int count = 0; count < _state.cage.num_cells(); count++) {
@@ -241,12 +242,12 @@ void Bounding_Widget_3d::update_2d_geometry_straight(BoundingCage::KeyFrameItera
     renderer_2d.update_polyline_3d(skeleton_polyline_id, skV.data(), sk_color, skV.rows(), sk_style);
 }
 
-bool Bounding_Widget_3d::post_draw_straight(const glm::vec4 &viewport, BoundingCage::KeyFrameIterator current_kf) {
+bool Bounding_Widget_3d::post_draw_straight(const glm::vec4 &viewport, const BoundingCage::Frame& current_frame) {
     // Back up the old viewport so we can restore it
     GLint old_viewport[4];
     glGetIntegerv(GL_VIEWPORT, old_viewport);
 
-    update_2d_geometry_straight(current_kf);
+    update_2d_geometry_straight(current_frame);
 
     glm::ivec2 viewport_size = glm::ivec2(viewport[2], viewport[3]);
     glm::ivec2 viewport_pos = glm::ivec2(viewport[0], viewport[1]);
@@ -309,12 +310,12 @@ bool Bounding_Widget_3d::post_draw_straight(const glm::vec4 &viewport, BoundingC
     return false;
 }
 
-bool Bounding_Widget_3d::post_draw_curved(const glm::vec4& viewport, BoundingCage::KeyFrameIterator current_kf) {
+bool Bounding_Widget_3d::post_draw_curved(const glm::vec4& viewport, const BoundingCage::Frame& current_frame) {
     // Back up the old viewport so we can restore it
     GLint old_viewport[4];
     glGetIntegerv(GL_VIEWPORT, old_viewport);
 
-    update_2d_geometry_curved(current_kf);
+    update_2d_geometry_curved(current_frame);
 
     glm::ivec2 viewport_size = glm::ivec2(viewport[2], viewport[3]);
     glm::ivec2 viewport_pos = glm::ivec2(viewport[0], viewport[1]);
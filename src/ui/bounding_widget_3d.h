@@ -17,8 +17,8 @@ public:
     void initialize(igl::opengl::glfw::Viewer* viewer, Bounding_Polygon_Menu* parent);
     void deinitialize();
     bool pre_draw(float current_cut_index);
-    bool post_draw_curved(const glm::vec4& viewport, BoundingCage::KeyFrameIterator current_kf);
-    bool post_draw_straight(const glm::vec4& viewport, BoundingCage::KeyFrameIterator current_kf);
+    bool post_draw_curved(const glm::vec4& viewport, const BoundingCage::Frame& current_frame);
+    bool post_draw_straight(const glm::vec4& viewport, const BoundingCage::Frame& current_frame);
 
     VolumeRenderer volume_renderer;
     PointLineRenderer renderer_2d;
@@ -31,8 +31,8 @@ public:
 private:
 
     void update_volume_geometry(const Eigen::RowVector3d& volume_size, const Eigen::MatrixXd& cage_V, const Eigen::MatrixXi& cage_F);
-    void update_2d_geometry_curved(BoundingCage::KeyFrameIterator current_kf);
-    void update_2d_geometry_straight(BoundingCage::KeyFrameIterator current_kf);
+    void update_2d_geometry_curved(const BoundingCage::Frame& current_frame);
+    void update_2d_geometry_straight(const BoundingCage::Frame& current_frame);
 
     int cage_polyline_id;
     int current_kf_polyline_id;
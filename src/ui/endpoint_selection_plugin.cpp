@@ -3,10 +3,11 @@
 #include "state.h"
 #include "utils/colors.h"
 #include "utils/utils.h"
+#include "utils/tet_mesh_topology.h"
+#include "utils/mesh_graph.h"
 
 #include <igl/boundary_facets.h>
-#include <igl/marching_tets.h>
-#include <igl/unproject_onto_mesh.h>
+#include <igl/get_seconds.h>
 #include <imgui/imgui.h>
 #include <imgui/imgui_internal.h>
 #include <unordered_set>
@@ -39,41 +40,44 @@ bool validate_endpoint_pairs(const std::vector<std::pair<int, int>>& endpoints,
 }
 
 
-void compute_skeleton(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT,
+void compute_skeleton(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& E,
                       const Eigen::VectorXd normalized_distances,
                       const std::vector<std::pair<int, int>>& endpoint_pairs,
                       const Eigen::VectorXi& connected_components,
                       int num_skeleton_vertices,
                       Eigen::MatrixXd& skeleton_vertices) {
-    std::vector<Eigen::MatrixXi> TT_comps;
-    split_mesh_components(TT, connected_components, TT_comps);
-
-    Eigen::MatrixXd LV;
-    Eigen::MatrixXi LF;
-
     int vertex_count = 0;
-    skeleton_vertices.resize(num_skeleton_vertices, 3);
+    skeleton_vertices.resize(endpoint_pairs.size() * num_skeleton_vertices, 3);
 
+    Eigen::MatrixXd LC;
+    Eigen::VectorXi LC_counts;
     for (int ep_i = 0; ep_i < endpoint_pairs.size(); ep_i++) {
         const int component = connected_components[endpoint_pairs[ep_i].first];
         skeleton_vertices.row(vertex_count) = TV.row(endpoint_pairs[ep_i].first);
         vertex_count++;
 
+        Eigen::MatrixXi E_comp(E.rows(), 2);
+        int num_comp_edges = 0;
+        for (int i = 0; i < E.rows(); i++) {
+            if (connected_components[E(i, 0)] == component) {
+                E_comp.row(num_comp_edges++) = E.row(i);
+            }
+        }
+        E_comp.conservativeResize(num_comp_edges, 2);
+
+        // Centroids of all the level sets strictly between the two endpoints, computed in one sweep
         const double nd_ep0 = normalized_distances[endpoint_pairs[ep_i].first];
         const double nd_ep1 = normalized_distances[endpoint_pairs[ep_i].second];
         const double isoval_incr = (nd_ep1 - nd_ep0) / num_skeleton_vertices;
-
-        double isovalue = normalized_distances[endpoint_pairs[ep_i].first] + isoval_incr;
-        for (int i = 0; i < num_skeleton_vertices - 2; i++) {
-            igl::marching_tets(TV, TT_comps[component], normalized_distances, isovalue, LV, LF);
-            if (LV.rows() == 0) {
-                isovalue += isoval_incr;
+        level_set_centroids(TV, E_comp, normalized_distances,
+                            nd_ep0 + isoval_incr, isoval_incr, num_skeleton_vertices - 2,
+                            LC, LC_counts);
+        for (int i = 0; i < LC.rows(); i++) {
+            if (LC_counts[i] == 0) {
                 continue;
             }
-            Eigen::RowVector3d c = LV.colwise().sum() / LV.rows();
-            skeleton_vertices.row(vertex_count) = c;
+            skeleton_vertices.row(vertex_count) = LC.row(i);
             vertex_count += 1;
-            isovalue += isoval_incr;
         }
 
         skeleton_vertices.row(vertex_count) = TV.row(endpoint_pairs[ep_i].second);
@@ -89,6 +93,8 @@ void compute_skeleton(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT,
 EndPoint_Selection_Menu::EndPoint_Selection_Menu(State& state) : state(state) {
   extracting_skeleton = false;
   done_extracting_skeleton = false;
+  proposing_endpoints = false;
+  done_proposing_endpoints = false;
 }
 
 
@@ -106,6 +112,7 @@ void EndPoint_Selection_Menu::initialize() {
     const Eigen::MatrixXi& TF = state.dilated_tet_mesh.TF;
     viewer->data().set_mesh(TV, TF);
     viewer->core.align_camera_center(TV, TF);
+    update_boundary_tree();
 
     viewer->append_mesh();
     points_overlay_id = static_cast<int>(viewer->selected_data_index);
@@ -118,13 +125,11 @@ void EndPoint_Selection_Menu::initialize() {
     glfwGetWindowSize(viewer->window, &window_width, &window_height);
     viewer->core.viewport = Eigen::RowVector4f(view_hsplit*window_width, 0, (1.0-view_hsplit)*window_width, window_height);
 
+    selecting_endpoints = false;
     if (state.dirty_flags.endpoints_dirty) {
-        state.skeleton_estimation_parameters.endpoint_pairs.clear();
+        propose_endpoints();
         state.dirty_flags.endpoints_dirty = false;
         state.dirty_flags.bounding_cage_dirty = true;
-        selecting_endpoints = true;
-    } else {
-        selecting_endpoints = false;
     }
 
     current_endpoint_idx = 0;
@@ -135,6 +140,104 @@ void EndPoint_Selection_Menu::initialize() {
     debug.drew_debug_state = false;
 }
 
+void EndPoint_Selection_Menu::update_boundary_tree() {
+    if (boundary_tree_revision == state.dilated_tet_mesh.revision) {
+        return;
+    }
+
+    const Eigen::MatrixXd& TV = state.dilated_tet_mesh.TV;
+    const Eigen::MatrixXi& TF = state.dilated_tet_mesh.TF;
+    const double start_time = igl::get_seconds();
+    boundary_tree.deinit();
+    boundary_tree.init(TV, TF);
+    boundary_tree_revision = state.dilated_tet_mesh.revision;
+    state.logger->debug("Built picking tree over {} boundary faces in {:.3f}s", TF.rows(), igl::get_seconds() - start_time);
+
+    if (debug.enabled) {
+        const RayBenchmarkStats stats = benchmark_surface_rays(boundary_tree, TV, TF, 10000);
+        state.logger->debug("Picking benchmark: {:.0f} rays/s ({} of {} rays hit)",
+                            stats.rays_per_second, stats.num_hits, stats.num_rays);
+    }
+}
+
+void EndPoint_Selection_Menu::update_edge_graph() {
+    if (edge_graph_revision == state.dilated_tet_mesh.revision) {
+        return;
+    }
+
+    const Eigen::MatrixXd& TV = state.dilated_tet_mesh.TV;
+    const Eigen::MatrixXi& TT = state.dilated_tet_mesh.TT;
+    tet_mesh_edges(TT, TV.rows(), mesh_edges);
+    build_edge_graph(TV, mesh_edges, edge_graph);
+    edge_graph_revision = state.dilated_tet_mesh.revision;
+}
+
+void EndPoint_Selection_Menu::propose_endpoints() {
+    if (proposing_endpoints) {
+        return;
+    }
+    proposing_endpoints = true;
+    done_proposing_endpoints = false;
+
+    auto thread_fun = [&]() {
+        glfwPostEmptyEvent();
+
+        const Eigen::MatrixXi& TT = state.dilated_tet_mesh.TT;
+        proposed_endpoint_pairs.clear();
+        if (TT.rows() > 0) {
+            const double start_time = igl::get_seconds();
+            update_edge_graph();
+
+            MeshComponents partition;
+            partition_mesh_components(TT, state.dilated_tet_mesh.connected_components, partition, true);
+            std::vector<std::pair<int, int>> endpoints;
+            Eigen::VectorXd lengths;
+            graph_diameter_endpoints(edge_graph, partition.vertices, partition.vertex_offsets, endpoints, lengths);
+
+            // Components much shorter than the longest one are specks left over from the segmentation, not specimens
+            const double min_length = state.skeleton_estimation_parameters.min_component_length * lengths.maxCoeff();
+            int num_skipped = 0;
+            for (int c = 0; c < int(endpoints.size()); c++) {
+                if (endpoints[c].first < 0) {
+                    continue;
+                }
+                if (lengths[c] >= min_length) {
+                    proposed_endpoint_pairs.push_back(endpoints[c]);
+                } else {
+                    state.logger->debug("Skipping component {} of length {:.3f}", c, lengths[c]);
+                    num_skipped += 1;
+                }
+            }
+            if (num_skipped > 0) {
+                state.logger->info("Skipped {} components shorter than {:.3f}", num_skipped, min_length);
+            }
+            state.logger->info("Proposed endpoints for {} of {} components in {:.3f}s",
+                               proposed_endpoint_pairs.size(), endpoints.size(), igl::get_seconds() - start_time);
+        }
+
+        done_proposing_endpoints = true;
+        proposing_endpoints = false;
+        glfwPostEmptyEvent();
+    };
+
+    propose_endpoints_thread = std::thread(thread_fun);
+    propose_endpoints_thread.detach();
+}
+
+void EndPoint_Selection_Menu::apply_proposed_endpoints() {
+    if (!done_proposing_endpoints) {
+        return;
+    }
+    done_proposing_endpoints = false;
+
+    state.skeleton_estimation_parameters.endpoint_pairs = std::move(proposed_endpoint_pairs);
+    proposed_endpoint_pairs.clear();
+    state.dirty_flags.bounding_cage_dirty = true;
+    current_endpoint_idx = 0;
+    current_endpoints = { -1, -1 };
+    selecting_endpoints = state.skeleton_estimation_parameters.endpoint_pairs.empty();
+}
+
 void EndPoint_Selection_Menu::deinitialize() {
     for (size_t i = viewer->data_list.size() - 1; i > 0; i--) {
         viewer->erase_mesh(i);
@@ -150,6 +253,7 @@ bool EndPoint_Selection_Menu::pre_draw() {
 
     bool ret = FishUIViewerPlugin::pre_draw();
     const Eigen::MatrixXd& TV = state.dilated_tet_mesh.TV;
+    apply_proposed_endpoints();
 
     int push_mesh_id = static_cast<int>(viewer->selected_data_index);
     viewer->selected_data_index = points_overlay_id;
@@ -298,6 +402,14 @@ bool EndPoint_Selection_Menu::post_draw() {
         }
     }
 
+    if (proposing_endpoints) {
+        ImGui::OpenPopup("Proposing Endpoints");
+        ImGui::BeginPopupModal("Proposing Endpoints");
+        ImGui::Text("Finding the endpoints of each component. Please wait, this may take a few seconds.");
+        ImGui::NewLine();
+        ImGui::EndPopup();
+    }
+
     if (extracting_skeleton) {
         ImGui::OpenPopup("Extracting Skeleton");
         ImGui::BeginPopupModal("Extracting Skeleton");
@@ -340,6 +452,10 @@ bool EndPoint_Selection_Menu::post_draw() {
         ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f);
     }
 
+    if (!selecting_endpoints && ImGui::Button("Propose Endpoints", ImVec2(-1, 0))) {
+        propose_endpoints();
+    }
+
     if (selecting_endpoints) {
         ImGui::PopItemFlag();
         ImGui::PopStyleVar();
@@ -356,7 +472,7 @@ bool EndPoint_Selection_Menu::post_draw() {
     if (ImGui::CollapsingHeader("Advanced", nullptr, ImGuiTreeNodeFlags(0))) {
         float cage_bbox_rad = (float)state.skeleton_estimation_parameters.cage_bbox_radius;
         int num_subdivs = state.skeleton_estimation_parameters.num_subdivisions;
-        int smoothing_iters = state.skeleton_estimation_parameters.num_smoothing_iters;
+        float smoothing_stiffness = (float)state.skeleton_estimation_parameters.smoothing_stiffness;
 
         ImGui::Spacing();
         ImGui::Text("Skeleton Subdivisions:");
@@ -368,10 +484,10 @@ bool EndPoint_Selection_Menu::post_draw() {
         ImGui::PopItemWidth();
 
         ImGui::Spacing();
-        ImGui::Text("Skeleton Smoothing Iterations:");
+        ImGui::Text("Skeleton Smoothing Stiffness:");
         ImGui::PushItemWidth(-1);
-        if (ImGui::InputInt("##smoothingiters", &smoothing_iters, 1, 2)) {
-           state.skeleton_estimation_parameters.num_smoothing_iters = std::max(smoothing_iters, 0);
+        if (ImGui::InputFloat("##smoothingstiffness", &smoothing_stiffness, 1.0, 5.0)) {
+           state.skeleton_estimation_parameters.smoothing_stiffness = std::max((double)smoothing_stiffness, 0.0);
            state.dirty_flags.bounding_cage_dirty = true;
         }
         ImGui::PopItemWidth();
@@ -384,6 +500,51 @@ bool EndPoint_Selection_Menu::post_draw() {
             state.dirty_flags.bounding_cage_dirty = true;
         }
         ImGui::PopItemWidth();
+
+        ImGui::Spacing();
+        if (ImGui::Checkbox("Adaptive Sampling", &state.skeleton_estimation_parameters.adaptive_sampling)) {
+            state.dirty_flags.bounding_cage_dirty = true;
+        }
+        if (state.skeleton_estimation_parameters.adaptive_sampling) {
+            float sampling_tol = (float)state.skeleton_estimation_parameters.sampling_tolerance;
+            ImGui::Text("Sampling Tolerance:");
+            ImGui::PushItemWidth(-1);
+            if (ImGui::InputFloat("##samplingtol", &sampling_tol, 0.1, 0.5)) {
+                state.skeleton_estimation_parameters.sampling_tolerance = std::max((double)sampling_tol, 0.01);
+                state.dirty_flags.bounding_cage_dirty = true;
+            }
+            ImGui::PopItemWidth();
+        }
+
+        ImGui::Spacing();
+        float min_component_length = (float)state.skeleton_estimation_parameters.min_component_length;
+        ImGui::Text("Min. Proposed Component Length:");
+        ImGui::PushItemWidth(-1);
+        if (ImGui::InputFloat("##mincomplength", &min_component_length, 0.05, 0.1)) {
+            state.skeleton_estimation_parameters.min_component_length =
+                    std::min(std::max((double)min_component_length, 0.0), 1.0);
+        }
+        ImGui::PopItemWidth();
+
+        ImGui::Spacing();
+        ImGui::Text("Distance Field:");
+        ImGui::PushItemWidth(-1);
+        int distance_method = int(state.skeleton_estimation_parameters.distance_method);
+        if (ImGui::Combo("##distancemethod", &distance_method, "Heat Method\0Harmonic\0")) {
+            state.skeleton_estimation_parameters.distance_method = DistanceMethod(distance_method);
+            state.dirty_flags.bounding_cage_dirty = true;
+        }
+        ImGui::PopItemWidth();
+
+        ImGui::Spacing();
+        ImGui::Text("Distance Solver:");
+        ImGui::PushItemWidth(-1);
+        int distance_solver = int(state.skeleton_estimation_parameters.distance_solver);
+        if (ImGui::Combo("##distancesolver", &distance_solver, "Direct (LDLT)\0Conjugate Gradient\0")) {
+            state.skeleton_estimation_parameters.distance_solver = DistanceSolver(distance_solver);
+            state.dirty_flags.bounding_cage_dirty = true;
+        }
+        ImGui::PopItemWidth();
     }
 
     ImGui::NewLine();
@@ -393,7 +554,11 @@ bool EndPoint_Selection_Menu::post_draw() {
         state.set_application_state(Application_State::Segmentation);
     }
     ImGui::SameLine();
-    if (state.skeleton_estimation_parameters.endpoint_pairs.empty()) {
+    // The skeleton is extracted from the proposed endpoints with the same cached edges, so wait until the
+    // proposal is installed
+    const bool next_disabled = state.skeleton_estimation_parameters.endpoint_pairs.empty() ||
+            proposing_endpoints || done_proposing_endpoints;
+    if (next_disabled) {
         ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
         ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f);
     }
@@ -406,7 +571,7 @@ bool EndPoint_Selection_Menu::post_draw() {
             done_extracting_skeleton = true;
         }
     }
-    if (state.skeleton_estimation_parameters.endpoint_pairs.empty()) {
+    if (next_disabled) {
         ImGui::PopItemFlag();
         ImGui::PopStyleVar();
     }
@@ -418,7 +583,7 @@ bool EndPoint_Selection_Menu::post_draw() {
 
 bool EndPoint_Selection_Menu::key_down(int key, int modifier) {
     bool ret = FishUIViewerPlugin::key_down(key, modifier);
-    if (!selecting_endpoints) {
+    if (!selecting_endpoints || proposing_endpoints) {
         return ret;
     }
     if (key != 32) {
@@ -430,10 +595,10 @@ bool EndPoint_Selection_Menu::key_down(int key, int modifier) {
     double x = viewer->current_mouse_x;
     double y = viewer->core.viewport(3) - viewer->current_mouse_y;
 
-    if (igl::unproject_onto_mesh(Eigen::Vector2f(x, y),
+    update_boundary_tree();
+    if (pick_surface(boundary_tree, state.dilated_tet_mesh.TV, state.dilated_tet_mesh.TF, Eigen::Vector2f(x, y),
             viewer->core.view * viewer->core.model,
-            viewer->core.proj, viewer->core.viewport,
-            state.dilated_tet_mesh.TV, state.dilated_tet_mesh.TF, fid, bc))
+            viewer->core.proj, viewer->core.viewport, fid, bc))
     {
         int max;
         bc.maxCoeff(&max);
@@ -475,6 +640,9 @@ bool EndPoint_Selection_Menu::key_down(int key, int modifier) {
 
 
 void EndPoint_Selection_Menu::extract_skeleton() {
+    // The mesh does not change while the skeleton is extracted, so the cached edges are safe to read from the thread
+    update_edge_graph();
+
     auto thread_fun = [&]() {
         extracting_skeleton = true;
         glfwPostEmptyEvent();
@@ -482,39 +650,51 @@ void EndPoint_Selection_Menu::extract_skeleton() {
         const Eigen::MatrixXd& TV = state.dilated_tet_mesh.TV;
         const Eigen::MatrixXi& TT = state.dilated_tet_mesh.TT;
         const Eigen::VectorXi& C = state.dilated_tet_mesh.connected_components;
-        const int comp = C[state.skeleton_estimation_parameters.endpoint_pairs[0].first];
-
-        Eigen::MatrixXd TV2;
-        Eigen::MatrixXi TT2;
-        Eigen::VectorXi C2;
-        Eigen::VectorXi CMap;
-        Eigen::VectorXd geodesic_dists2;
-        std::vector<std::pair<int, int>> selected_endpoints_2;
-        remesh_connected_components(comp, C, TV, TT, CMap, TV2, TT2);
-        C2 = Eigen::VectorXi::Zero(TV2.rows());
-        for (const std::pair<int, int>& p : state.skeleton_estimation_parameters.endpoint_pairs) {
-            std::pair<int, int> p2 = std::make_pair(CMap[p.first], CMap[p.second]);
-            selected_endpoints_2.push_back(p2);
+        ComponentDistanceOperators& distance_operators = state.dilated_tet_mesh.distance_operators;
+        const DistanceSolver solver = state.skeleton_estimation_parameters.distance_solver;
+
+        // The operators only depend on the mesh so each component is factored once and reused for new endpoints
+        const int num_prepared = distance_operators.solver() == solver ? distance_operators.num_initialized() : 0;
+        const double precompute_start_time = igl::get_seconds();
+        if (!distance_operators.precompute(TV, TT, C, state.skeleton_estimation_parameters.endpoint_pairs, solver)) {
+            state.logger->error("Failed to factor the distance operators of the tet mesh");
+        }
+        if (distance_operators.num_initialized() > num_prepared) {
+            state.logger->info("Prepared distance operators for {} components in {:.3f}s",
+                               distance_operators.num_initialized() - num_prepared,
+                               igl::get_seconds() - precompute_start_time);
+        }
+
+        // Components with endpoints are solved in parallel. With the harmonic method the previous
+        // distances are the initial guess of the iterative solver.
+        const DistanceMethod method = state.skeleton_estimation_parameters.distance_method;
+        const double distances_start_time = igl::get_seconds();
+        DistanceSolveStats solve_stats;
+        if (!distance_operators.distances(state.skeleton_estimation_parameters.endpoint_pairs, method,
+                                          state.dilated_tet_mesh.geodesic_dists, &solve_stats)) {
+            state.logger->error("Failed to compute geodesic distances");
+            state.dilated_tet_mesh.geodesic_dists.setConstant(TV.rows(), -1.0);
+        }
+        state.logger->info("Computed geodesic distances in {:.3f}s", igl::get_seconds() - distances_start_time);
+        if (solver == DistanceSolver::ConjugateGradient) {
+            const bool heat = method == DistanceMethod::Heat;
+            state.logger->info("{}: {} iterations, relative residual {:.3e}", heat ? "Heat step" : "Harmonic solve",
+                               solve_stats.diffusion.iterations, solve_stats.diffusion.residual);
+            state.logger->info("{}: {} iterations, relative residual {:.3e}", heat ? "Poisson step" : "Gradient fit",
+                               solve_stats.integration.iterations, solve_stats.integration.residual);
         }
-        Eigen::MatrixXd skeleton_vertices;
 
-        const bool normalized = true;
-        geodesic_distances(TV2, TT2, selected_endpoints_2, geodesic_dists2, normalized);
-        compute_skeleton(TV2, TT2, geodesic_dists2,
-            selected_endpoints_2, C2,
+        Eigen::MatrixXd skeleton_vertices;
+        compute_skeleton(TV, mesh_edges, state.dilated_tet_mesh.geodesic_dists,
+            state.skeleton_estimation_parameters.endpoint_pairs, C,
             state.skeleton_estimation_parameters.num_subdivisions, skeleton_vertices);
 
-        state.dilated_tet_mesh.geodesic_dists.resize(TV.rows());
-        for (int i = 0; i < TV.rows(); i++) {
-            if (CMap[i] >= 0) {
-                state.dilated_tet_mesh.geodesic_dists[i] = geodesic_dists2[CMap[i]];
-            } else {
-                state.dilated_tet_mesh.geodesic_dists[i] = -1.0;
-            }
-        }
         const double rad = state.skeleton_estimation_parameters.cage_bbox_radius;
         Eigen::Vector4d bbox(-rad, rad, -rad, rad);
-        state.cage.set_skeleton_vertices(skeleton_vertices, state.skeleton_estimation_parameters.num_smoothing_iters, bbox);
+        const double sampling_tol = state.skeleton_estimation_parameters.adaptive_sampling ?
+                    state.skeleton_estimation_parameters.sampling_tolerance : 0.0;
+        state.cage.set_skeleton_vertices(skeleton_vertices, state.skeleton_estimation_parameters.smoothing_stiffness,
+                                         bbox, sampling_tol);
 
         extracting_skeleton = false;
         done_extracting_skeleton = true;
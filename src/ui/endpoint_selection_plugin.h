@@ -2,10 +2,14 @@
 #define __FISH_DEFORMATION_ENDPOINT_SELECTION_STATE__
 
 #include "fish_ui_viewer_plugin.h"
+#include "utils/surface_picking.h"
+#include "utils/mesh_graph.h"
 
 #include <array>
 #include <atomic>
 #include <thread>
+#include <utility>
+#include <vector>
 
 struct State;
 
@@ -39,6 +43,13 @@ private:
     std::atomic_bool done_extracting_skeleton;
     std::thread extract_skeleton_thread;
 
+    // Endpoints are proposed on a background thread into proposed_endpoint_pairs, which the UI thread moves
+    // into the state once done_proposing_endpoints is set
+    std::atomic_bool proposing_endpoints;
+    std::atomic_bool done_proposing_endpoints;
+    std::thread propose_endpoints_thread;
+    std::vector<std::pair<int, int>> proposed_endpoint_pairs;
+
 
     bool bad_selection = false; // Flag set to true if user selects invalid endpoint pair
     std::string bad_selection_error_message;
@@ -49,6 +60,24 @@ private:
     int mesh_overlay_id;
     int points_overlay_id;
 
+    // Bounding volume hierarchy over the boundary of the dilated mesh used to pick endpoints. It is rebuilt
+    // when the revision of the mesh changes.
+    SurfaceTree boundary_tree;
+    int boundary_tree_revision = -1;
+    void update_boundary_tree();
+
+    // Edges of the dilated mesh and their graph, used to propose endpoints and extract the skeleton. They are
+    // rebuilt when the revision of the mesh changes.
+    Eigen::MatrixXi mesh_edges;
+    EdgeGraph edge_graph;
+    int edge_graph_revision = -1;
+    void update_edge_graph();
+
+    // Replace the endpoint pairs with the approximate diameter of each connected component. The search runs in
+    // the background and apply_proposed_endpoints installs its result.
+    void propose_endpoints();
+    void apply_proposed_endpoints();
+
     void extract_skeleton();
 };
 
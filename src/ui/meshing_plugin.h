@@ -3,6 +3,8 @@
 
 #include "fish_ui_viewer_plugin.h"
 
+#include <utils/decimate_surface.h>
+
 #include <atomic>
 #include <thread>
 
@@ -31,6 +33,9 @@ private:
         Eigen::MatrixXi F_fat;
     } extracted_surface;
 
+    // Summary of the last decimation of the dilated surface
+    DecimationStats decimation_stats;
+
     std::thread bg_thread;
     std::atomic_bool is_meshing;
     std::atomic_bool done_meshing;
@@ -40,6 +45,7 @@ private:
     void export_selected_volume(const std::vector<uint32_t>& feature_list);
     void tetrahedralize_surface_mesh();
     void dilate_volume();
+    void decimate_surface_mesh();
     void extract_surface_mesh();
 };
 
@@ -281,6 +281,21 @@ bool Selection_Menu::post_draw() {
             _state.dirty_flags.mesh_dirty = true;
         }
         ImGui::PopItemWidth();
+
+        ImGui::Spacing();
+        if (ImGui::Checkbox("Decimate Dilated Surface", &_state.dilated_tet_mesh.surface_decimation_enabled)) {
+            _state.dirty_flags.mesh_dirty = true;
+        }
+        if (_state.dilated_tet_mesh.surface_decimation_enabled) {
+            float decimation_tolerance = (float)_state.dilated_tet_mesh.surface_decimation_tolerance;
+            ImGui::Text("Decimation Tolerance (Voxel Widths):");
+            ImGui::PushItemWidth(-1);
+            if (ImGui::InputFloat("##decimationtolerance", &decimation_tolerance, 0.05, 0.1)) {
+                _state.dilated_tet_mesh.surface_decimation_tolerance = std::max((double)decimation_tolerance, 0.0);
+                _state.dirty_flags.mesh_dirty = true;
+            }
+            ImGui::PopItemWidth();
+        }
     }
     ImGui::NewLine();
     ImGui::Separator();
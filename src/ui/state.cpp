@@ -1,5 +1,7 @@
 #include "state.h"
 
+#include <algorithm>
+
 
 void State::SegmentedFeatures::recompute_feature_map() {
     selected_features.clear();
@@ -116,15 +118,14 @@ void State::LoadedVolume::load_gl_index_texture() {
                  0, GL_RED_INTEGER, GL_UNSIGNED_INT, idata);
 }
 
+void State::DilatedTetMesh::update_topology() {
+    tet_mesh_topology(TT, TV.rows(), topology, TF, connected_components);
+    distance_operators.clear();
+    revision += 1;
+}
+
 void State::serialize(std::vector<char> &buffer) const {
-    igl::serialize(input_metadata.input_dir, std::string("image_input.input_dir"), buffer);
-    igl::serialize(input_metadata.output_dir, std::string("image_input.output_dir"), buffer);
-    igl::serialize(input_metadata.file_extension, std::string("image_input.file_extension"), buffer);
-    igl::serialize(input_metadata.prefix, std::string("image_input.prefix"), buffer);
-    igl::serialize(input_metadata.downsample_factor, std::string("image_input.downsample_factor"), buffer);
-    igl::serialize(input_metadata.start_index, std::string("image_input.start_index"), buffer);
-    igl::serialize(input_metadata.end_index, std::string("image_input.end_index"), buffer);
-    igl::serialize(input_metadata.project_name, std::string("image_input.project_name"), buffer);
+    input_metadata.serialize(buffer);
 
 
     igl::serialize(dilated_tet_mesh.TV, std::string("dilated_tet_mesh.TV"), buffer);
@@ -133,13 +134,20 @@ void State::serialize(std::vector<char> &buffer) const {
     igl::serialize(dilated_tet_mesh.connected_components, std::string("dilated_tet_mesh.connected_components"), buffer);
     igl::serialize(dilated_tet_mesh.dilation_radius, std::string("dilated_tet_mesh.dilation_radius"), buffer);
     igl::serialize(dilated_tet_mesh.meshing_voxel_radius, std::string("dilated_tet_mesh.meshing_voxel_radius"), buffer);
+    igl::serialize(dilated_tet_mesh.surface_decimation_enabled, std::string("dilated_tet_mesh.surface_decimation_enabled"), buffer);
+    igl::serialize(dilated_tet_mesh.surface_decimation_tolerance, std::string("dilated_tet_mesh.surface_decimation_tolerance"), buffer);
     igl::serialize(dilated_tet_mesh.geodesic_dists, std::string("dilated_tet_mesh.geodesic_dists"), buffer);
 
 
     igl::serialize(skeleton_estimation_parameters.num_subdivisions, std::string("skeleton_estimation_parameters.num_subdivisions"), buffer);
-    igl::serialize(skeleton_estimation_parameters.num_smoothing_iters, std::string("skeleton_estimation_parameters.num_smoothing_iters"), buffer);
+    igl::serialize(skeleton_estimation_parameters.smoothing_stiffness, std::string("skeleton_estimation_parameters.smoothing_stiffness"), buffer);
     igl::serialize(skeleton_estimation_parameters.cage_bbox_radius, std::string("skeleton_estimation_parameters.cage_bbox_radius"), buffer);
+    igl::serialize(skeleton_estimation_parameters.adaptive_sampling, std::string("skeleton_estimation_parameters.adaptive_sampling"), buffer);
+    igl::serialize(skeleton_estimation_parameters.sampling_tolerance, std::string("skeleton_estimation_parameters.sampling_tolerance"), buffer);
+    igl::serialize(skeleton_estimation_parameters.min_component_length, std::string("skeleton_estimation_parameters.min_component_length"), buffer);
     igl::serialize(skeleton_estimation_parameters.endpoint_pairs, std::string("skeleton_estimation_parameters.endpoint_pairs"), buffer);
+    igl::serialize(int(skeleton_estimation_parameters.distance_method), std::string("skeleton_estimation_parameters.distance_method"), buffer);
+    igl::serialize(int(skeleton_estimation_parameters.distance_solver), std::string("skeleton_estimation_parameters.distance_solver"), buffer);
 
 
     igl::serialize(segmented_features.selected_features, std::string("segmented_features.selected_features"), buffer);
@@ -154,14 +162,7 @@ void State::serialize(std::vector<char> &buffer) const {
 }
 
 void State::deserialize(const std::vector<char> &buffer) {
-    igl::deserialize(input_metadata.input_dir, std::string("image_input.input_dir"), buffer);
-    igl::deserialize(input_metadata.output_dir, std::string("image_input.output_dir"), buffer);
-    igl::deserialize(input_metadata.file_extension, std::string("image_input.file_extension"), buffer);
-    igl::deserialize(input_metadata.prefix, std::string("image_input.prefix"), buffer);
-    igl::deserialize(input_metadata.downsample_factor, std::string("image_input.downsample_factor"), buffer);
-    igl::deserialize(input_metadata.start_index, std::string("image_input.start_index"), buffer);
-    igl::deserialize(input_metadata.end_index, std::string("image_input.end_index"), buffer);
-    igl::deserialize(input_metadata.project_name, std::string("image_input.project_name"), buffer);
+    input_metadata.deserialize(buffer);
 
 
     igl::deserialize(dilated_tet_mesh.TV, std::string("dilated_tet_mesh.TV"), buffer);
@@ -170,13 +171,34 @@ void State::deserialize(const std::vector<char> &buffer) {
     igl::deserialize(dilated_tet_mesh.connected_components, std::string("dilated_tet_mesh.connected_components"), buffer);
     igl::deserialize(dilated_tet_mesh.dilation_radius, std::string("dilated_tet_mesh.dilation_radius"), buffer);
     igl::deserialize(dilated_tet_mesh.meshing_voxel_radius, std::string("dilated_tet_mesh.meshing_voxel_radius"), buffer);
+    igl::deserialize(dilated_tet_mesh.surface_decimation_enabled, std::string("dilated_tet_mesh.surface_decimation_enabled"), buffer);
+    igl::deserialize(dilated_tet_mesh.surface_decimation_tolerance, std::string("dilated_tet_mesh.surface_decimation_tolerance"), buffer);
     igl::deserialize(dilated_tet_mesh.geodesic_dists, std::string("dilated_tet_mesh.geodesic_dists"), buffer);
+    if (dilated_tet_mesh.TT.rows() > 0) {
+        dilated_tet_mesh.update_topology();
+    }
 
 
     igl::deserialize(skeleton_estimation_parameters.num_subdivisions, std::string("skeleton_estimation_parameters.num_subdivisions"), buffer);
-    igl::deserialize(skeleton_estimation_parameters.num_smoothing_iters, std::string("skeleton_estimation_parameters.num_smoothing_iters"), buffer);
+    if (!igl::deserialize(skeleton_estimation_parameters.smoothing_stiffness, std::string("skeleton_estimation_parameters.smoothing_stiffness"), buffer)) {
+        // Older projects store a number of neighbor averaging passes instead of a stiffness
+        int num_smoothing_iters = 0;
+        if (igl::deserialize(num_smoothing_iters, std::string("skeleton_estimation_parameters.num_smoothing_iters"), buffer)) {
+            skeleton_estimation_parameters.smoothing_stiffness = std::max(0.5*num_smoothing_iters, 0.0);
+        }
+    }
     igl::deserialize(skeleton_estimation_parameters.cage_bbox_radius, std::string("skeleton_estimation_parameters.cage_bbox_radius"), buffer);
+    igl::deserialize(skeleton_estimation_parameters.adaptive_sampling, std::string("skeleton_estimation_parameters.adaptive_sampling"), buffer);
+    igl::deserialize(skeleton_estimation_parameters.sampling_tolerance, std::string("skeleton_estimation_parameters.sampling_tolerance"), buffer);
+    igl::deserialize(skeleton_estimation_parameters.min_component_length, std::string("skeleton_estimation_parameters.min_component_length"), buffer);
     igl::deserialize(skeleton_estimation_parameters.endpoint_pairs, std::string("skeleton_estimation_parameters.endpoint_pairs"), buffer);
+    // Projects saved before the method was selectable used the harmonic field
+    int distance_method = int(DistanceMethod::Harmonic);
+    igl::deserialize(distance_method, std::string("skeleton_estimation_parameters.distance_method"), buffer);
+    skeleton_estimation_parameters.distance_method = DistanceMethod(distance_method);
+    int distance_solver = int(DistanceSolver::Direct);
+    igl::deserialize(distance_solver, std::string("skeleton_estimation_parameters.distance_solver"), buffer);
+    skeleton_estimation_parameters.distance_solver = DistanceSolver(distance_solver);
 
 
     igl::deserialize(segmented_features.num_selected_features, std::string("segmented_features.num_selected_features"), buffer);
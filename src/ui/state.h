@@ -5,6 +5,9 @@
 #include <utils/bounding_cage.h>
 #include <utils/utils.h>
 #include <utils/datfile.h>
+#include <utils/tet_mesh_topology.h>
+#include <utils/distance_operators.h>
+#include <utils/project_file.h>
 
 #include <array>
 #include <glad/glad.h>
@@ -94,36 +97,7 @@ struct State {
 
     } segmented_features;
 
-    struct ImageInput {
-        std::string input_dir;
-        std::string output_dir;
-        std::string file_extension;
-        std::string prefix;
-        std::string project_name;
-
-        int downsample_factor = 8;
-        int start_index;
-        int end_index;
-
-        std::string full_res_prefix() {
-            std::string str = prefix + std::string("-") + std::to_string(start_index) + std::string("-") + std::to_string(end_index);
-            return str;
-        }
-
-        std::string low_res_prefix() {
-            std::string str = prefix + std::string("-") + std::to_string(start_index) + std::string("-") + std::to_string(end_index) + std::string("-") + std::to_string(downsample_factor);
-            return str;
-        }
-
-        std::string low_res_path_prefx() {
-            return output_dir + "/" + low_res_prefix();
-        }
-
-        std::string full_res_path_prefix() {
-            return output_dir + "/" + full_res_prefix();
-        }
-
-    } input_metadata;
+    ImageInput input_metadata;
 
     // Output of the dilation and tetrahedralization
     struct DilatedTetMesh {
@@ -135,15 +109,37 @@ struct State {
         double dilation_radius = 3.0;
         double meshing_voxel_radius = 1.5;
 
+        // Simplify the dilated surface before tetrahedralizing it. Edge collapses may move the
+        // surface by at most surface_decimation_tolerance * meshing_voxel_radius.
+        bool surface_decimation_enabled = false;
+        double surface_decimation_tolerance = 0.25;
+
         // Geodesic distances stored at each tet vertex
         Eigen::VectorXd geodesic_dists;
 
+        // Face adjacency and per-tet components. This is derived from TT and is not serialized.
+        TetMeshTopology topology;
+
+        // Operators and factorizations used to compute geodesic_dists on each connected component. A component's
+        // operators are built the first time it has endpoints and are reused until the mesh changes.
+        ComponentDistanceOperators distance_operators;
+
+        // Incremented every time the mesh changes, so data derived from it can be cached and rebuilt lazily.
+        // This is not serialized.
+        int revision = 0;
+
+        // Recompute TF, connected_components and topology from TT
+        void update_topology();
+
         void clear() {
             TV.resize(0, 0);
             TF.resize(0, 0);
             TT.resize(0, 0);
             connected_components.resize(0);
             geodesic_dists.resize(0);
+            topology.clear();
+            distance_operators.clear();
+            revision += 1;
         }
     } dilated_tet_mesh;
 
@@ -151,11 +147,29 @@ struct State {
         // Number of level sets in the skeleton
         int num_subdivisions = 100;
 
-        // Number of smoothing iterations
-        int num_smoothing_iters = 50;
+        // Stiffness of the implicit skeleton smoothing (see BoundingCage::set_skeleton_vertices). Zero disables
+        // smoothing.
+        double smoothing_stiffness = 25.0;
 
         double cage_bbox_radius = 7.5;
 
+        // Simplify the sampled skeleton before fitting the cage, so it has fewer vertices on straight parts
+        // and more where it bends. The simplified skeleton stays within sampling_tolerance of the full one.
+        bool adaptive_sampling = false;
+        double sampling_tolerance = 0.5;
+
+        // Propose endpoints only for components whose diameter is at least this fraction of the longest one.
+        // Shorter ones are specks left over from the segmentation.
+        double min_component_length = 0.1;
+
+        // Distance field whose level sets define the skeleton. The harmonic field with a gradient fit is the
+        // original method, and the heat method is available as an option.
+        DistanceMethod distance_method = DistanceMethod::Harmonic;
+
+        // Solver for the distance field systems. The direct solver is fastest on small meshes, but
+        // the memory of its factorizations grows much faster than the mesh.
+        DistanceSolver distance_solver = DistanceSolver::Direct;
+
         // Selected pairs of endpoints
         std::vector<std::pair<int, int>> endpoint_pairs;
     } skeleton_estimation_parameters;
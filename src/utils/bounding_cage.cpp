@@ -3,8 +3,13 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
-#include <igl/copyleft/cgal/convex_hull.h>
-#include <igl/per_face_normals.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+#include <igl/parallel_for.h>
 #include <igl/triangle/triangulate.h>
 #include <igl/segment_segment_intersect.h>
 
@@ -18,7 +23,7 @@
 //}
 
 
-static Eigen::Matrix3d parallel_transport(const Eigen::MatrixXd& kf_coord_frame, Eigen::RowVector3d to_n) {
+static Eigen::Matrix3d parallel_transport(const Eigen::Matrix3d& kf_coord_frame, Eigen::RowVector3d to_n) {
     Eigen::RowVector3d normal = kf_coord_frame.row(2);
     Eigen::Matrix3d R = Eigen::Quaterniond::FromTwoVectors(normal.normalized(), to_n.normalized()).matrix();
     Eigen::Matrix3d coord_system = (R*kf_coord_frame.transpose()).transpose();
@@ -26,6 +31,54 @@ static Eigen::Matrix3d parallel_transport(const Eigen::MatrixXd& kf_coord_frame,
     return coord_system;
 }
 
+// Signed angle about the shared normal of two coordinate systems which rotates the right axis of from onto the
+// right axis of to
+static double twist_angle(const Eigen::Matrix3d& from, const Eigen::Matrix3d& to) {
+    const Eigen::RowVector3d a = from.row(0), b = to.row(0);
+    return atan2(a.cross(b).dot(to.row(2)), a.dot(b));
+}
+
+// Douglas-Peucker simplification of the polyline P. Returns the indices of the vertices kept so that every
+// removed vertex is within tolerance of the segment replacing it. The first and last vertices are always kept and
+// vertices accumulate where the polyline bends.
+static std::vector<int> simplify_polyline(const Eigen::MatrixXd& P, double tolerance) {
+    const int n = P.rows();
+    std::vector<char> keep(n, 0);
+    keep[0] = keep[n-1] = 1;
+
+    std::vector<std::pair<int, int>> stack;
+    stack.emplace_back(0, n-1);
+    while (!stack.empty()) {
+        const int first = stack.back().first, last = stack.back().second;
+        stack.pop_back();
+
+        const Eigen::RowVector3d a = P.row(first);
+        const Eigen::RowVector3d ab = P.row(last) - a;
+        const double ab_sq = ab.squaredNorm();
+        double max_dist = 0.0;
+        int farthest = -1;
+        for (int i = first + 1; i < last; i++) {
+            const double t = ab_sq > 0.0 ? std::min(1.0, std::max(0.0, (P.row(i) - a).dot(ab) / ab_sq)) : 0.0;
+            const double dist = (P.row(i) - (a + t*ab)).norm();
+            if (dist > max_dist) {
+                max_dist = dist;
+                farthest = i;
+            }
+        }
+        if (farthest >= 0 && max_dist > tolerance) {
+            keep[farthest] = 1;
+            stack.emplace_back(first, farthest);
+            stack.emplace_back(farthest, last);
+        }
+    }
+
+    std::vector<int> kept;
+    for (int i = 0; i < n; i++) {
+        if (keep[i]) { kept.push_back(i); }
+    }
+    return kept;
+}
+
 // Construct a 3x3 rotation matrix whose 3rd row is normal
 static Eigen::Matrix3d local_coordinate_system(const Eigen::RowVector3d& normal) {
     Eigen::RowVector3d plane_normal = normal;
@@ -73,29 +126,6 @@ static Eigen::Matrix3d local_coordinate_system(const Eigen::RowVector3d& normal)
 // |                                | //
 // |================================| //
 
-BoundingCage::KeyFrame::KeyFrame(const Eigen::RowVector3d& normal,
-                                 const Eigen::RowVector3d& center,
-                                 const BoundingCage::KeyFrame& from_kf,
-                                 const double angle,
-                                 const Eigen::MatrixXd& pts,
-                                 const Eigen::RowVector2d& centroid,
-                                 std::shared_ptr<BoundingCage::Cell> cell,
-                                 double idx,
-                                 BoundingCage* cage) {
-    _cage = cage;
-    _index = idx;
-    _orientation = parallel_transport(from_kf._orientation, normal);
-    _angle = angle;
-    _centroid_2d = centroid;
-    _origin = center;
-    _vertices_2d = pts;
-
-    _left_cell = cell;
-    _right_cell = cell;
-
-    logger = _cage->logger;
-}
-
 BoundingCage::KeyFrame::KeyFrame(const Eigen::RowVector3d& center,
                                  const Eigen::Matrix3d& coord_frame,
                                  const double angle,
@@ -125,6 +155,7 @@ bool BoundingCage::KeyFrame::move_centroid_2d(const Eigen::RowVector2d& new_cent
     }
 
     _centroid_2d = new_centroid_2d;
+    _cage->keyframe_edited(_slot);
     return true;
 }
 
@@ -135,6 +166,7 @@ bool BoundingCage::KeyFrame::rotate_about_normal(double d_angle) {
     }
 
     _angle += d_angle;
+    _cage->keyframe_edited(_slot);
     return true;
 }
 
@@ -147,6 +179,7 @@ bool BoundingCage::KeyFrame::rotate_about_right(double d_angle) {
     Eigen::AngleAxisd R(d_angle, _orientation.row(0));
     Eigen::Matrix3d O = _orientation;
     _orientation = O*R;
+    _cage->keyframe_edited(_slot);
     return true;
 }
 
@@ -159,6 +192,7 @@ bool BoundingCage::KeyFrame::rotate_about_up(double d_angle) {
     Eigen::AngleAxisd R(d_angle, _orientation.row(1));
     Eigen::Matrix3d O = _orientation;
     _orientation = O*R;
+    _cage->keyframe_edited(_slot);
     return true;
 }
 
@@ -169,6 +203,7 @@ bool BoundingCage::KeyFrame::set_angle(double angle) {
     }
 
     _angle = angle;
+    _cage->keyframe_edited(_slot);
     return true;
 }
 
@@ -192,6 +227,299 @@ void BoundingCage::KeyFrame::deserialize(const std::vector<char>& buffer) {
     igl::deserialize(_angle, std::string("angle"), buffer);
 }
 
+BoundingCage::KeyFrameStatePtr BoundingCage::KeyFrame::state() const {
+    KeyFrameState* state = new KeyFrameState;
+    state->index = _index;
+    state->angle = _angle;
+    state->origin = _origin;
+    state->orientation = _orientation;
+    state->centroid_2d = _centroid_2d;
+    return KeyFrameStatePtr(state);
+}
+
+
+// |-------------------------------------| //
+// |                                     | //
+// | BoundingCage::KeyFrameArray methods | //
+// |                                     | //
+// |=====================================| //
+
+void BoundingCage::KeyFrameArray::reset(const std::shared_ptr<KeyFrame>& front,
+                                        const std::shared_ptr<KeyFrame>& back,
+                                        Cell* root,
+                                        const SkeletonFrames& frames) {
+    clear();
+    for (const std::shared_ptr<KeyFrame>& kf : { front, back }) {
+        indices.push_back(kf->index());
+        origins.push_back(kf->_origin);
+        orientations.push_back(kf->_orientation);
+        centroids_2d.push_back(kf->_centroid_2d);
+        angles.push_back(kf->_angle);
+        twists.push_back(frames.twist(kf->_index, kf->_orientation));
+        kf->_slot = int(keyframes.size());
+        keyframes.push_back(kf);
+    }
+    cells.push_back(root);
+}
+
+void BoundingCage::KeyFrameArray::assign(const std::vector<std::shared_ptr<KeyFrame>>& kfs,
+                                         const std::vector<Cell*>& leaves,
+                                         const SkeletonFrames& frames) {
+    assert("Need one leaf Cell between every pair of KeyFrames" && leaves.size() + 1 == kfs.size());
+    clear();
+    indices.reserve(kfs.size());
+    origins.reserve(kfs.size());
+    orientations.reserve(kfs.size());
+    centroids_2d.reserve(kfs.size());
+    angles.reserve(kfs.size());
+    twists.reserve(kfs.size());
+    for (int i = 0; i < int(kfs.size()); i++) {
+        const KeyFrame& kf = *kfs[i];
+        indices.push_back(kf._index);
+        origins.push_back(kf._origin);
+        orientations.push_back(kf._orientation);
+        centroids_2d.push_back(kf._centroid_2d);
+        angles.push_back(kf._angle);
+        twists.push_back(frames.twist(kf._index, kf._orientation));
+        kfs[i]->_slot = i;
+    }
+    keyframes = kfs;
+    cells = leaves;
+}
+
+void BoundingCage::KeyFrameArray::insert(int slot, const std::shared_ptr<KeyFrame>& kf, Cell* left, Cell* right,
+                                         const SkeletonFrames& frames) {
+    assert("KeyFrame must be inserted between two KeyFrames" && slot > 0 && slot < size());
+    assert("KeyFrame inserted out of order" && indices[slot-1] < kf->index() && kf->index() < indices[slot]);
+
+    indices.insert(indices.begin() + slot, kf->index());
+    origins.insert(origins.begin() + slot, kf->_origin);
+    orientations.insert(orientations.begin() + slot, kf->_orientation);
+    centroids_2d.insert(centroids_2d.begin() + slot, kf->_centroid_2d);
+    angles.insert(angles.begin() + slot, kf->_angle);
+    twists.insert(twists.begin() + slot, frames.twist(kf->_index, kf->_orientation));
+    keyframes.insert(keyframes.begin() + slot, kf);
+
+    cells[slot-1] = left;
+    cells.insert(cells.begin() + slot, right);
+    invalidate_depths(slot);
+
+    for (int i = slot; i < size(); i++) {
+        keyframes[i]->_slot = i;
+    }
+}
+
+void BoundingCage::KeyFrameArray::erase(int slot) {
+    assert("Cannot erase an endpoint KeyFrame" && slot > 0 && slot < size()-1);
+
+    keyframes[slot]->_slot = -1;
+    indices.erase(indices.begin() + slot);
+    origins.erase(origins.begin() + slot);
+    orientations.erase(orientations.begin() + slot);
+    centroids_2d.erase(centroids_2d.begin() + slot);
+    angles.erase(angles.begin() + slot);
+    twists.erase(twists.begin() + slot);
+    keyframes.erase(keyframes.begin() + slot);
+    cells.erase(cells.begin() + slot);
+    invalidate_depths(slot);
+
+    for (int i = slot; i < size(); i++) {
+        keyframes[i]->_slot = i;
+    }
+}
+
+void BoundingCage::KeyFrameArray::update(int slot, const SkeletonFrames& frames) {
+    const KeyFrame& kf = *keyframes[slot];
+    origins[slot] = kf._origin;
+    orientations[slot] = kf._orientation;
+    centroids_2d[slot] = kf._centroid_2d;
+    angles[slot] = kf._angle;
+    twists[slot] = frames.twist(kf._index, kf._orientation);
+    invalidate_depths(slot);
+}
+
+int BoundingCage::KeyFrameArray::upper_bound(double index) const {
+    return int(std::upper_bound(indices.begin(), indices.end(), index) - indices.begin());
+}
+
+void BoundingCage::KeyFrameArray::clear() {
+    for (const std::shared_ptr<KeyFrame>& kf : keyframes) {
+        kf->_slot = -1;
+    }
+    indices.clear();
+    origins.clear();
+    orientations.clear();
+    centroids_2d.clear();
+    angles.clear();
+    twists.clear();
+    keyframes.clear();
+    cells.clear();
+    depths.clear();
+    depths_dirty_from = 0;
+}
+
+
+// |--------------------------------------| //
+// |                                      | //
+// | BoundingCage::SkeletonFrames methods | //
+// |                                      | //
+// |======================================| //
+
+void BoundingCage::SkeletonFrames::compute(const Eigen::MatrixXd& SV) {
+    const int n = SV.rows();
+    clear();
+    if (n < 2) {
+        return;
+    }
+
+    // Tangents use the same differences as the KeyFrame normals, central inside and one sided at the ends.
+    // Repeated vertices keep the previous tangent.
+    tangents.resize(n, 3);
+    arc_lengths.resize(n);
+    arc_lengths[0] = 0.0;
+    for (int i = 0; i < n; i++) {
+        Eigen::RowVector3d t = SV.row(std::min(i+1, n-1)) - SV.row(std::max(i-1, 0));
+        if (t.squaredNorm() <= 0.0) {
+            t = i > 0 ? Eigen::RowVector3d(tangents.row(i-1)) : Eigen::RowVector3d(0, 0, 1);
+        }
+        tangents.row(i) = t.normalized();
+        if (i > 0) {
+            arc_lengths[i] = arc_lengths[i-1] + (SV.row(i) - SV.row(i-1)).norm();
+        }
+    }
+
+    // Double reflection method (Wang et al. 2008): reflect the frame across the bisector plane of each segment,
+    // then across the plane between the reflected and actual tangents at the next vertex.
+    rights.resize(n, 3);
+    rights.row(0) = local_coordinate_system(tangents.row(0)).row(0);
+    for (int i = 0; i < n-1; i++) {
+        const Eigen::RowVector3d r = rights.row(i), t = tangents.row(i);
+        const Eigen::RowVector3d v1 = SV.row(i+1) - SV.row(i);
+        const double c1 = v1.squaredNorm();
+        Eigen::RowVector3d r_next = r;
+        if (c1 > 0.0) {
+            const Eigen::RowVector3d r_l = r - (2.0/c1)*v1.dot(r)*v1;
+            const Eigen::RowVector3d t_l = t - (2.0/c1)*v1.dot(t)*v1;
+            const Eigen::RowVector3d v2 = tangents.row(i+1) - t_l;
+            const double c2 = v2.squaredNorm();
+            r_next = c2 > 0.0 ? Eigen::RowVector3d(r_l - (2.0/c2)*v2.dot(r_l)*v2) : r_l;
+        }
+
+        // Keep the frame orthonormal as rounding errors accumulate
+        const Eigen::RowVector3d t_next = tangents.row(i+1);
+        rights.row(i+1) = (r_next - r_next.dot(t_next)*t_next).normalized();
+    }
+
+    // Keep the rotations on the same side as the identity, so interpolate() takes the short way around
+    rotations.resize(n-1);
+    for (int i = 0; i < n-1; i++) {
+        rotations[i] = Eigen::Quaterniond(Eigen::Matrix3d(vertex_frame(i+1).transpose()*vertex_frame(i)));
+        if (rotations[i].w() < 0.0) {
+            rotations[i].coeffs() *= -1.0;
+        }
+    }
+}
+
+Eigen::Quaterniond BoundingCage::SkeletonFrames::interpolate(int i, double coeff) const {
+    // Frames at neighboring vertices differ by a small rotation, where normalized linear interpolation is as
+    // smooth as a slerp and much cheaper
+    Eigen::Quaterniond q;
+    q.coeffs() = coeff*rotations[i].coeffs();
+    q.w() += 1.0 - coeff;
+    return q.normalized();
+}
+
+Eigen::Matrix3d BoundingCage::SkeletonFrames::vertex_frame(int i) const {
+    // Frames have the right handedness of local_coordinate_system(), with up = right x normal
+    const Eigen::RowVector3d r = rights.row(i), t = tangents.row(i);
+    Eigen::Matrix3d F;
+    F.row(0) = r;
+    F.row(1) = r.cross(t);
+    F.row(2) = t;
+    return F;
+}
+
+Eigen::Matrix3d BoundingCage::SkeletonFrames::frame(double index) const {
+    assert("Skeleton frames are not computed" && !empty());
+    const int n = tangents.rows();
+    index = std::max(0.0, std::min(index, double(n-1)));
+    const int i = std::min(int(index), n-2);
+    const double coeff = index - i;
+
+    const Eigen::Matrix3d F0 = vertex_frame(i);
+    if (coeff == 0.0) {
+        return F0;
+    } else if (coeff == 1.0) {
+        return vertex_frame(i+1);
+    }
+
+    // Slerp the rotation taking the axes at vertex i to the axes at vertex i+1
+    const Eigen::Matrix3d R = interpolate(i, coeff).toRotationMatrix();
+    return (R*F0.transpose()).transpose();
+}
+
+Eigen::Matrix3d BoundingCage::SkeletonFrames::transported_frame(double index, const Eigen::RowVector3d& n,
+                                                               double angle) const {
+    assert("Skeleton frames are not computed" && !empty());
+    const int num_vertices = tangents.rows();
+    index = std::max(0.0, std::min(index, double(num_vertices-1)));
+    const int i = std::min(int(index), num_vertices-2);
+    const double coeff = index - i;
+
+    // Compose the rotation between the vertex frames, the rotation of the skeleton tangent onto n and the twist
+    // about n, so the axes of the vertex frame are only rotated once
+    const Eigen::Matrix3d F0 = vertex_frame(i);
+    const Eigen::Quaterniond R = interpolate(i, coeff);
+    const Eigen::Vector3d tangent = R*Eigen::Vector3d(F0.row(2).transpose());
+    const Eigen::Vector3d normal = n.transpose().normalized();
+    const Eigen::Quaterniond q = Eigen::AngleAxisd(angle, normal)*Eigen::Quaterniond::FromTwoVectors(tangent, normal)*R;
+    return (q.toRotationMatrix()*F0.transpose()).transpose();
+}
+
+double BoundingCage::SkeletonFrames::twist(double index, const Eigen::Matrix3d& orientation) const {
+    if (empty()) {
+        return 0.0;
+    }
+    return twist_angle(parallel_transport(frame(index), orientation.row(2)), orientation);
+}
+
+double BoundingCage::SkeletonFrames::arc_length(double index) const {
+    if (empty()) {
+        return 0.0;
+    }
+    const int n = arc_lengths.size();
+    index = std::max(0.0, std::min(index, double(n-1)));
+    const int i = std::min(int(index), n-2);
+    const double coeff = index - i;
+    return (1.0-coeff)*arc_lengths[i] + coeff*arc_lengths[i+1];
+}
+
+double BoundingCage::SkeletonFrames::index_for_arc_length(double length) const {
+    if (empty()) {
+        return 0.0;
+    }
+    const int n = arc_lengths.size();
+    if (length <= 0.0) {
+        return 0.0;
+    } else if (length >= arc_lengths[n-1]) {
+        return double(n-1);
+    }
+
+    // Segment i is the last one starting at or before length. Repeated vertices give empty segments, which
+    // upper_bound skips.
+    const double* begin = arc_lengths.data();
+    const int i = std::min(int(std::upper_bound(begin, begin + n, length) - begin) - 1, n-2);
+    const double segment_length = arc_lengths[i+1] - arc_lengths[i];
+    return segment_length > 0.0 ? i + (length - arc_lengths[i]) / segment_length : double(i);
+}
+
+void BoundingCage::SkeletonFrames::clear() {
+    tangents.resize(0, 3);
+    rights.resize(0, 3);
+    arc_lengths.resize(0);
+    rotations.clear();
+}
+
 
 // |----------------------------| //
 // |                            | //
@@ -308,10 +636,6 @@ std::shared_ptr<BoundingCage::KeyFrame> BoundingCage::Cell::split(std::shared_pt
         keyframe->_left_cell = _left_child;
         keyframe->_right_cell = _right_child;
 
-        // If we added a cell with a different normal than the left key-frame, we need to recompute the
-        // the local coordinate frame of the right keyframe
-        _right_keyframe->_orientation = parallel_transport(_right_child->_left_keyframe->_orientation, _right_keyframe->_orientation.row(2));
-
         return keyframe;
 
         // This node is not a leaf node, split one of the children
@@ -361,28 +685,46 @@ std::shared_ptr<BoundingCage::Cell> BoundingCage::Cell::find(double index) {
 // |                      | //
 // |======================| //
 
-bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, unsigned smoothing_iters, const Eigen::Vector4d& bounding_box) {
+bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, double smoothing_stiffness, const Eigen::Vector4d& bounding_box,
+                                         double simplification_tolerance) {
     assert(cells.begin() == cells.end());
     assert(keyframes.begin() == keyframes.end());
     assert(cells.rbegin() == cells.rend());
     assert(keyframes.rbegin() == keyframes.rend());
 
     const int UPSAMPLE_RATE = 4;
-    const int LOOKAHEAD = 1;
-
-    std::function<void(int)> smooth_skeleton = [&](int num_iters) {
-        Eigen::MatrixXd SV_i = SV;
-        SV_smooth.resize(SV_i.rows(), 3);
-        for (int iter = 0; iter < num_iters; iter++) {
-            SV_smooth.row(0) = SV_i.row(0);
-            for (int i = 1; i < SV_i.rows()-1; i++) {
-                SV_smooth.row(i) = 0.5 * (SV_i.row(i-1) + SV_i.row(i+1));
-            }
-            SV_smooth.row(SV_i.rows()-1) = SV_i.row(SV_i.rows()-1);
-            SV_i = SV_smooth;
+
+    // Implicit Laplacian smoothing with fixed endpoints: solve (I - stiffness*L) SV_smooth = SV, where L is the
+    // second difference along the skeleton. The system is tridiagonal and diagonally dominant, so one pass of the
+    // Thomas algorithm solves it for all three coordinates in O(n) however stiff it is. A stiffness of k/2 damps
+    // low frequencies like k iterations of neighbor averaging, and the result approaches the straight line
+    // between the endpoints as the stiffness grows.
+    std::function<void(double)> smooth_skeleton = [&](double stiffness) {
+        const int n = SV.rows();
+        SV_smooth = SV;
+        if (n < 3 || stiffness <= 0.0) {
+            return;
+        }
+
+        // Forward elimination. Row i is -s*x[i-1] + (1+2s)*x[i] - s*x[i+1] = SV[i] for interior i and
+        // x[i] = SV[i] at the endpoints, so the first row needs no elimination.
+        std::vector<double> c_prime(n, 0.0);
+        for (int i = 1; i < n-1; i++) {
+            const double m = 1.0 + 2.0*stiffness + stiffness*c_prime[i-1];
+            c_prime[i] = -stiffness / m;
+            SV_smooth.row(i) = (SV.row(i) + stiffness*SV_smooth.row(i-1)) / m;
+        }
+
+        // Back substitution from the fixed last vertex
+        for (int i = n-2; i > 0; i--) {
+            SV_smooth.row(i) -= c_prime[i]*SV_smooth.row(i+1);
         }
     };
 
+    // Indices of the smoothed skeleton vertices to split Cells at first, in increasing order. This is every
+    // vertex unless the skeleton is simplified.
+    std::vector<int> split_candidates;
+
     // Fit the an initial BoundingCage to the skeleton. This will
     // attempt to construct a series of prisms which fully enclose the skeleton
     // vertices.
@@ -395,8 +737,14 @@ bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, unsigned
             return true;
         }
 
-        // Otherwise split the cage node and try again
-        const int mid = cell->min_index() + (cell->max_index() - cell->min_index()) / 2;
+        // Otherwise split the cage node at the middle candidate inside it and try again. Cells with no candidate
+        // left inside are split at their middle vertex.
+        int mid = cell->min_index() + (cell->max_index() - cell->min_index()) / 2;
+        const auto first_candidate = std::upper_bound(split_candidates.begin(), split_candidates.end(), cell->min_index());
+        const auto end_candidate = std::lower_bound(first_candidate, split_candidates.end(), cell->max_index());
+        if (first_candidate != end_candidate) {
+            mid = *(first_candidate + (end_candidate - first_candidate) / 2);
+        }
         if (mid == cell->min_index() || mid == cell->max_index()) {
             logger->info("mid value, {}, equalled boundary ({}, {}), "
                          "while splitting cage cell in fit_cage_rec",
@@ -406,10 +754,8 @@ bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, unsigned
         assert("Bad mid index" && (mid > 0) && (mid < SV_smooth.rows()-1));
 
         Eigen::RowVector2d mid_centroid = 0.5 * (cell->_left_keyframe->centroid_2d() + cell->_right_keyframe->centroid_2d());
-        Eigen::RowVector3d mid_normal = (0.5 * (SV_smooth.row(mid+LOOKAHEAD) - SV_smooth.row(mid-LOOKAHEAD))).normalized();
         Eigen::MatrixXd mid_pts_2d = 0.5 * (cell->_left_keyframe->vertices_2d() + cell->_left_keyframe->vertices_2d());
-        std::shared_ptr<KeyFrame> mid_keyframe(new KeyFrame(mid_normal, SV_smooth.row(mid), *cell->_left_keyframe, 0.0, mid_pts_2d, mid_centroid, cell, mid, this));
-        assert("Parallel transport bug" && (1.0-fabs(mid_keyframe->normal().dot(mid_normal))) < 1e-6);
+        std::shared_ptr<KeyFrame> mid_keyframe(new KeyFrame(SV_smooth.row(mid), skeleton_frame(mid), 0.0, mid_pts_2d, mid_centroid, cell, mid, this));
 
         if(split_internal(mid_keyframe)) {
             bool ret = fit_cage_rec(cell->_left_child);
@@ -432,7 +778,18 @@ bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, unsigned
     }
 
     logger->debug("About to do smoothing pass");
-    smooth_skeleton(smoothing_iters);
+    smooth_skeleton(smoothing_stiffness);
+
+    // Split Cells at the smoothed vertices needed to follow the skeleton within the tolerance, so straight
+    // sections get few KeyFrames. The Cells must still contain every vertex of the full skeleton.
+    if (simplification_tolerance > 0.0 && SV_smooth.rows() > 2) {
+        split_candidates = simplify_polyline(SV_smooth, simplification_tolerance);
+        logger->info("Simplified skeleton from {} to {} split candidates with tolerance {}.",
+                     SV_smooth.rows(), split_candidates.size(), simplification_tolerance);
+    } else {
+        split_candidates.resize(SV_smooth.rows());
+        std::iota(split_candidates.begin(), split_candidates.end(), 0);
+    }
 
 //    logger->debug("Reparameterize");
 //    SV = SV_smooth;
@@ -458,10 +815,9 @@ bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, unsigned
 //    smooth_skeleton(UPSAMPLE_RATE*smoothing_iters);
 
 
-    Eigen::RowVector3d front_normal = SV_smooth.row(LOOKAHEAD) - SV_smooth.row(0);
-    Eigen::RowVector3d back_normal = SV_smooth.row(SV_smooth.rows()-1) - SV_smooth.row(SV_smooth.rows()-1-LOOKAHEAD);
-    front_normal.normalize();
-    back_normal.normalize();
+    // KeyFrames fit to the skeleton take their coordinate systems from the rotation minimizing frames, so
+    // they do not depend on which KeyFrames were inserted before them
+    _skeleton_frames.compute(SV_smooth);
 
     double min_u = bounding_box[0], max_u = bounding_box[1],
            min_v = bounding_box[2], max_v = bounding_box[3];
@@ -477,17 +833,14 @@ bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, unsigned
 
     Eigen::RowVector2d centroid = poly_template.colwise().mean();
 
-    Eigen::Matrix3d front_coord_system = local_coordinate_system(front_normal);
-    std::shared_ptr<KeyFrame> front_keyframe(new KeyFrame(SV_smooth.row(0), front_coord_system, 0.0, poly_template, centroid,
+    const int back_index = SV_smooth.rows()-1;
+    std::shared_ptr<KeyFrame> front_keyframe(new KeyFrame(SV_smooth.row(0), skeleton_frame(0), 0.0, poly_template, centroid,
                                                           std::shared_ptr<Cell>(), 0, this));
-    std::shared_ptr<KeyFrame> back_keyframe(new KeyFrame(back_normal, SV_smooth.row(SV_smooth.rows()-1), *front_keyframe, 0.0,
+    std::shared_ptr<KeyFrame> back_keyframe(new KeyFrame(SV_smooth.row(back_index), skeleton_frame(back_index), 0.0,
                                                          poly_template, centroid, std::shared_ptr<Cell>(),
-                                                         SV_smooth.rows()-1, this));
+                                                         back_index, this));
     front_keyframe->_in_cage = true;
     back_keyframe->_in_cage = true;
-    logger->debug("1-<bn, transport(fn)> = {}", 1.0-fabs(back_keyframe->normal().dot(back_normal)));
-
-    assert("Parallel transport bug" && (1.0-fabs(back_keyframe->normal().dot(back_normal))) < 1e-6);
 
     root = Cell::make_cell(front_keyframe, back_keyframe, this);
     if (!root) {
@@ -497,8 +850,7 @@ bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, unsigned
         return false;
     }
 
-    cells.head = root;
-    cells.tail = cells.head;
+    _keyframe_array.reset(front_keyframe, back_keyframe, root.get(), _skeleton_frames);
 
     if (!fit_cage_rec(root)) {
         logger->info("Initial bounding cage does not contain all the skeleton vertices.");
@@ -506,97 +858,212 @@ bool BoundingCage::set_skeleton_vertices(const Eigen::MatrixXd& new_SV, unsigned
         logger->info("Successfully fit all skeleton vertices inside BoundingCage.");
     }
 
+    reset_history();
     logger->info("Done constructing initial cage for skeleton.");
-    _num_keyframes += 2; // Head and tail keyframes
     return true;
 }
 
 BoundingCage::KeyFrameIterator BoundingCage::keyframe_for_index(double index) const {
-    std::shared_ptr<Cell> cell = root->find(index);
-
-    if (!cell) {
-        logger->error("vertices_2d_for_index() could not find cell at index {}", index);
-        assert("vertices_2d_for_index() could not find cell" && false);
+    const KeyFrameArray& kfa = _keyframe_array;
+    Frame frame;
+    if (!frame_for_index(index, frame)) {
+        logger->error("keyframe_for_index() could not find cell at index {}", index);
+        assert("keyframe_for_index() could not find cell" && false);
         return KeyFrameIterator();
     }
 
+    // The Cell containing index lies between KeyFrames left and left+1
+    const int left = std::min(kfa.upper_bound(index), kfa.size()-1) - 1;
+    const int right = left + 1;
+
     // If the index matches one of the cell boundaries, return the KeyFrame on that boundary
-    if (cell->min_index() == index) {
-        return KeyFrameIterator(cell->_left_keyframe);
-    } else if (cell->max_index() == index) {
-        return KeyFrameIterator(cell->_right_keyframe);
+    if (kfa.indices[left] == index) {
+        return KeyFrameIterator(kfa.keyframes[left].get());
+    } else if (kfa.indices[right] == index) {
+        return KeyFrameIterator(kfa.keyframes[right].get());
     }
 
-    const double coeff = (index - cell->min_index()) / (cell->max_index() - cell->min_index());
-    Eigen::MatrixXd V = (1.0-coeff)*cell->_left_keyframe->bounding_box_vertices_3d() + coeff*cell->_right_keyframe->bounding_box_vertices_3d();
-    Eigen::RowVector3d origin = (1.0-coeff)*cell->_left_keyframe->origin() + coeff*cell->_right_keyframe->origin();
+    Eigen::MatrixXd A = frame.bounding_box_vertices_3d.rowwise() - frame.origin;
+    Eigen::MatrixXd points2d(A.rows(), 2);
+    points2d.col(0) = A*frame.orientation.row(0).transpose();
+    points2d.col(1) = A*frame.orientation.row(1).transpose();
 
+    std::shared_ptr<Cell> cell = kfa.cells[left]->shared_from_this();
+    std::shared_ptr<KeyFrame> kf(new KeyFrame(frame.origin, frame.orientation, frame.angle, points2d, frame.centroid_2d,
+                                              cell, index, (BoundingCage*)this));
+    return KeyFrameIterator(kf);
+}
+
+// Fill in the rotated axes, 3d centroid and bounding box corners of a Frame from its origin, orientation,
+// torsion angle and 2d centroid. This is the same computation as the KeyFrame accessors.
+static void complete_frame(const Eigen::Vector4d& bbox, BoundingCage::Frame& frame) {
+    const Eigen::Matrix3d& O = frame.orientation;
+    const Eigen::AngleAxisd R(-frame.angle, O.row(2));
+    const Eigen::Matrix3d O_rotated = (R*O.transpose()).transpose();
+    frame.right_rotated = O_rotated.row(0);
+    frame.up_rotated = O_rotated.row(1);
+    frame.centroid_3d = frame.origin + O.row(0)*frame.centroid_2d[0] + O.row(1)*frame.centroid_2d[1];
+
+    const Eigen::RowVector3d& r = frame.right_rotated;
+    const Eigen::RowVector3d& u = frame.up_rotated;
+    const double min_u = bbox[0], max_u = bbox[1], min_v = bbox[2], max_v = bbox[3];
+    frame.bounding_box_vertices_3d.row(0) = r*min_u + u*min_v + frame.centroid_3d;
+    frame.bounding_box_vertices_3d.row(1) = r*max_u + u*min_v + frame.centroid_3d;
+    frame.bounding_box_vertices_3d.row(2) = r*max_u + u*max_v + frame.centroid_3d;
+    frame.bounding_box_vertices_3d.row(3) = r*min_u + u*max_v + frame.centroid_3d;
+}
 
-    Eigen::MatrixXd A = V.rowwise() - origin;
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(A, Eigen::ComputeThinV);
-    Eigen::RowVector3d n = svd.matrixV().col(2).transpose();
-    double sign = 1.0;
-    if (n.dot(cell->_left_keyframe->normal()) < 0.0 || n.dot(cell->_right_keyframe->normal()) < 0.0) {
-        sign = -1.0;
+void BoundingCage::frame_for_slot(int slot, Frame& frame) const {
+    frame.index = _keyframe_array.indices[slot];
+    frame.angle = _keyframe_array.angles[slot];
+    frame.origin = _keyframe_array.origins[slot];
+    frame.orientation = _keyframe_array.orientations[slot];
+    frame.centroid_2d = _keyframe_array.centroids_2d[slot];
+    complete_frame(_keyframe_bounding_box, frame);
+}
+
+bool BoundingCage::frame_for_index(double index, Frame& frame) const {
+    const KeyFrameArray& kfa = _keyframe_array;
+    if (kfa.size() < 2 || index < kfa.indices.front() || index > kfa.indices.back()) {
+        return false;
     }
-    n *= sign;
 
-    double angle = (1.0-coeff)*cell->_left_keyframe->angle() + coeff*cell->_right_keyframe->angle();
+    const int left = std::min(kfa.upper_bound(index), kfa.size()-1) - 1;
+    const int right = left + 1;
+    if (kfa.indices[left] == index) {
+        frame_for_slot(left, frame);
+        return true;
+    } else if (kfa.indices[right] == index) {
+        frame_for_slot(right, frame);
+        return true;
+    }
 
-    Eigen::Matrix3d coord_frame = parallel_transport(cell->_left_keyframe->_orientation, n);
+    Frame left_frame, right_frame;
+    frame_for_slot(left, left_frame);
+    frame_for_slot(right, right_frame);
+    const double coeff = (index - kfa.indices[left]) / (kfa.indices[right] - kfa.indices[left]);
+
+    // The interpolated bounding box is a (possibly slightly skewed) quad. The cross product of its
+    // diagonals is its area-weighted normal, which is exact when the quad is planar.
+    const Eigen::Matrix<double, 4, 3> V = (1.0-coeff)*left_frame.bounding_box_vertices_3d +
+                                          coeff*right_frame.bounding_box_vertices_3d;
+    const Eigen::RowVector3d d02 = V.row(2) - V.row(0);
+    const Eigen::RowVector3d d13 = V.row(3) - V.row(1);
+    Eigen::RowVector3d n = d02.cross(d13);
+    if (n.squaredNorm() <= 1e-24) {
+        n = (1.0-coeff)*left_frame.orientation.row(2) + coeff*right_frame.orientation.row(2);
+    }
+    n.normalize();
+    if (n.dot(left_frame.orientation.row(2)) < 0.0 || n.dot(right_frame.orientation.row(2)) < 0.0) {
+        n *= -1.0;
+    }
 
-    Eigen::MatrixXd points2d(V.rows(), 2);
-    points2d.col(0) = A*coord_frame.row(0).transpose();
-    points2d.col(1) = A*coord_frame.row(1).transpose();
+    frame.index = index;
+    frame.angle = (1.0-coeff)*left_frame.angle + coeff*right_frame.angle;
+    frame.origin = (1.0-coeff)*left_frame.origin + coeff*right_frame.origin;
+    if (_skeleton_frames.empty()) {
+        frame.orientation = parallel_transport(left_frame.orientation, n);
+    } else {
+        // Carry the rotation minimizing frame at index to the plane, then twist it by the interpolated twist of
+        // the two KeyFrames relative to the rotation minimizing frames at their own indices. This matches both
+        // KeyFrames exactly at the ends of the Cell.
+        const double twist_left = kfa.twists[left];
+        const double twist_right = twist_left + std::remainder(kfa.twists[right] - twist_left, 2.0*EIGEN_PI);
+        frame.orientation = _skeleton_frames.transported_frame(index, n, (1.0-coeff)*twist_left + coeff*twist_right);
+    }
+    frame.centroid_2d = (1.0-coeff)*left_frame.centroid_2d + coeff*right_frame.centroid_2d;
+    complete_frame(_keyframe_bounding_box, frame);
+    return true;
+}
 
-    Eigen::RowVector2d centroid2d = (1.0-coeff)*cell->_left_keyframe->centroid_2d() + coeff*cell->_right_keyframe->centroid_2d();
-    std::shared_ptr<KeyFrame> kf(new KeyFrame(origin, coord_frame, angle, points2d, centroid2d, cell, index, (BoundingCage*)this));
-    return KeyFrameIterator(kf);
+void BoundingCage::frames_for_indices(const Eigen::VectorXd& indices, Frames& frames) const {
+    frames.resize(indices.size());
+    if (num_keyframes() < 2) {
+        return;
+    }
+
+    const double lo = _keyframe_array.indices.front(), hi = _keyframe_array.indices.back();
+    igl::parallel_for(indices.size(), [&](const int i) {
+        frame_for_index(std::max(lo, std::min(indices[i], hi)), frames[i]);
+    }, 1000);
+}
+
+BoundingCage::KeyFrame* BoundingCage::keyframe_after(const KeyFrame* kf) const {
+    const int slot = kf->in_bounding_cage() ? kf->_slot + 1 : _keyframe_array.upper_bound(kf->index());
+    return slot < _keyframe_array.size() ? _keyframe_array.keyframes[slot].get() : nullptr;
+}
+
+BoundingCage::KeyFrame* BoundingCage::keyframe_before(const KeyFrame* kf) const {
+    const std::vector<double>& indices = _keyframe_array.indices;
+    const int slot = kf->in_bounding_cage() ? kf->_slot - 1 :
+        int(std::lower_bound(indices.begin(), indices.end(), kf->index()) - indices.begin()) - 1;
+    return slot >= 0 ? _keyframe_array.keyframes[slot].get() : nullptr;
+}
+
+BoundingCage::Cell* BoundingCage::cell_after(const Cell* cell) const {
+    const int slot = cell->_left_keyframe->_slot + 1;
+    return slot < int(_keyframe_array.cells.size()) ? _keyframe_array.cells[slot] : nullptr;
+}
+
+BoundingCage::Cell* BoundingCage::cell_before(const Cell* cell) const {
+    const int slot = cell->_left_keyframe->_slot - 1;
+    return slot >= 0 ? _keyframe_array.cells[slot] : nullptr;
 }
 
 bool BoundingCage::skeleton_in_cell(std::shared_ptr<Cell> cell) const {
     int start = cell->min_index();
     int end = cell->max_index();
-    std::shared_ptr<KeyFrame> left_kf = cell->_left_keyframe, right_kf = cell->_right_keyframe;
-
-    assert(left_kf->bounding_box_vertices_2d().rows() == right_kf->bounding_box_vertices_2d().rows());
-    Eigen::MatrixXd CHV(left_kf->bounding_box_vertices_2d().rows() + right_kf->bounding_box_vertices_2d().rows(), 3);
-    CHV.block(0, 0, left_kf->bounding_box_vertices_2d().rows(), 3) = left_kf->bounding_box_vertices_3d();
-    CHV.block(left_kf->bounding_box_vertices_2d().rows(), 0, right_kf->bounding_box_vertices_2d().rows(), 3) = right_kf->bounding_box_vertices_3d();
-
-    Eigen::MatrixXd V;
-    Eigen::MatrixXi F;
-    igl::copyleft::cgal::convex_hull(CHV, V, F);
-    if (CHV.rows() != V.rows()) {
-        logger->warn("Convex Hull of keyframes for Cell does not enclose all its points. "
-                     "There were {} input points but the convex hull had {} points.",
-                     CHV.rows(), V.rows());
-    }
 
     assert(start < end);
     if ((end - start) <= 1) {
         return false;
     }
 
-    auto sgn = [](double val) -> int {
-        return (double(0) < val) - (val < double(0));
-    };
+    // The prism is bounded by the triangles of Cell::mesh_faces(). Each one gives a plane n.x = d oriented
+    // so the center of the prism is on its negative side.
+    const Eigen::MatrixXd V = cell->mesh_vertices();
+    const Eigen::MatrixXi F = cell->mesh_faces();
+    const Eigen::RowVector3d center = V.colwise().mean();
 
-    Eigen::MatrixXd C(F.rows(), 3);
+    Eigen::Matrix<double, 12, 3> N;
+    Eigen::Matrix<double, 12, 1> d;
+    assert(F.rows() == N.rows());
     for (int i = 0; i < F.rows(); i++) {
-        C.row(i) = (V.row(F(i, 0)) + V.row(F(i, 1)) + V.row(F(i, 2))) / 3;
-    }
-
-    // Computing the normals here is fine since this function only gets called
-    // on construction when the cage is very simple
-    Eigen::MatrixXd N;
-    igl::per_face_normals_stable(V, F, N);
-    const int check_sign = sgn(N.row(0).dot(SV_smooth.row(start+1)-C.row(0)));
-    for (int i = 0; i < end-start-1; i++) {
-        const Eigen::RowVector3d V = SV_smooth.row(start+1+i);
-        for (int j = 0; j < N.rows(); j++) {
-            const int sign = sgn(N.row(j).dot(V-C.row(j)));
-            if (sign != check_sign) {
+        const Eigen::RowVector3d v0 = V.row(F(i, 0));
+        const Eigen::RowVector3d e1 = V.row(F(i, 1)) - v0;
+        const Eigen::RowVector3d e2 = V.row(F(i, 2)) - v0;
+        Eigen::RowVector3d n = e1.cross(e2);
+        const double len = n.norm();
+        n = len > 0.0 ? Eigen::RowVector3d(n / len) : Eigen::RowVector3d::Zero();
+        const double sign = n.dot(center - v0) > 0.0 ? -1.0 : 1.0;
+        N.row(i) = sign*n;
+        d[i] = sign*n.dot(v0);
+    }
+
+    // Consecutive faces are the two triangles of one quad of the prism. If the quad is bent outwards a point
+    // is inside it when it is behind both planes, and if it is bent inwards, when it is behind either one.
+    bool convex[6];
+    for (int i = 0; i < F.rows(); i += 2) {
+        int apex = F(i+1, 0);
+        for (int j = 0; j < 3; j++) {
+            if (F(i+1, j) != F(i, 0) && F(i+1, j) != F(i, 1) && F(i+1, j) != F(i, 2)) { apex = F(i+1, j); }
+        }
+        convex[i/2] = N.row(i).dot(V.row(apex)) - d[i] <= 0.0;
+    }
+
+    // Test the skeleton vertices strictly inside the cell's index range in blocks, so cells which fail
+    // are rejected early
+    const int BLOCK_SIZE = 256;
+    const int first = start + 1, count = end - start - 1;
+    Eigen::Matrix<double, 12, Eigen::Dynamic> D;
+    for (int b = 0; b < count; b += BLOCK_SIZE) {
+        const int n = std::min(BLOCK_SIZE, count - b);
+        D.noalias() = N*SV_smooth.middleRows(first + b, n).transpose();
+        D.colwise() -= d;
+        for (int i = 0; i < 6; i++) {
+            const bool inside = convex[i] ? (D.row(2*i).cwiseMax(D.row(2*i+1)).array() <= 0.0).all() :
+                                            (D.row(2*i).cwiseMin(D.row(2*i+1)).array() <= 0.0).all();
+            if (!inside) {
                 return false;
             }
         }
@@ -631,31 +1098,30 @@ std::shared_ptr<BoundingCage::KeyFrame> BoundingCage::split_internal(std::shared
         return std::shared_ptr<KeyFrame>();
     }
 
-    // If we split the head or tail of the Cell list, then update those pointers
-    if (left_cell == cells.head) {
-        cells.head = left_cell->_left_child;
-    }
-    if (right_cell == cells.tail) {
-        cells.tail = right_cell->_right_child;
-    }
-
-    _num_keyframes += 1;
+    // The new KeyFrame goes right after the left KeyFrame of the Cell it split
+    const int slot = cell->_left_keyframe->_slot + 1;
     split_kf->_in_cage = true;
+    _keyframe_array.insert(slot, split_kf, cell->_left_child.get(), cell->_right_child.get(), _skeleton_frames);
+    mark_edited(split_kf);
     return split_kf;
 }
 
 BoundingCage::KeyFrameIterator BoundingCage::insert_keyframe(double index) {
-    return KeyFrameIterator(split_internal(keyframe_for_index(index).keyframe));
+    KeyFrameIterator it = keyframe_for_index(index);
+    return insert_keyframe(it);
 }
 
 BoundingCage::KeyFrameIterator BoundingCage::insert_keyframe(BoundingCage::KeyFrameIterator& split_kf) {
-    return KeyFrameIterator(split_internal(split_kf.keyframe));
+    if (!split_kf.keyframe) {
+        return KeyFrameIterator();
+    }
+    return KeyFrameIterator(split_internal(split_kf.keyframe->shared_from_this()));
 }
 
 bool BoundingCage::delete_keyframe(KeyFrameIterator& it) {
-    std::shared_ptr<KeyFrame> kf = it.keyframe;
-    if (!kf->in_bounding_cage()) {
-        logger->warn("Cannot remove keyframe at index {} which is not contained in BoundingCage", kf->index());
+    std::shared_ptr<KeyFrame> kf = it.keyframe ? it.keyframe->shared_from_this() : nullptr;
+    if (!kf || !kf->in_bounding_cage()) {
+        logger->warn("Cannot remove keyframe at index {} which is not contained in BoundingCage", kf ? kf->index() : -1.0);
         return false;
     }
 
@@ -693,24 +1159,45 @@ bool BoundingCage::delete_keyframe(KeyFrameIterator& it) {
         update = update->_parent_cell.lock();
     }
 
+    // The cage no longer owns the KeyFrame, so the iterator keeps it alive
+    mark_edited(kf);
+    _keyframe_array.erase(kf->_slot);
     kf->_in_cage = false;
-    _num_keyframes -= 1;
+    it.detached = kf;
     return true;
 }
 
 
+const std::vector<double>& BoundingCage::keyframe_depths() const {
+    const KeyFrameArray& kfa = _keyframe_array;
+    if (kfa.depths_dirty_from >= kfa.size()) {
+        return kfa.depths;
+    }
+
+    kfa.depths.resize(kfa.size());
+    int first = kfa.depths_dirty_from;
+    if (first == 0) {
+        kfa.depths[0] = 0.0;
+        first = 1;
+    }
+    Eigen::RowVector3d last_centroid = centroid_3d(first-1);
+    for (int i = first; i < kfa.size(); i++) {
+        const Eigen::RowVector3d centroid = centroid_3d(i);
+        kfa.depths[i] = kfa.depths[i-1] + (centroid - last_centroid).norm();
+        last_centroid = centroid;
+    }
+    kfa.depths_dirty_from = kfa.size();
+    return kfa.depths;
+}
+
 const Eigen::MatrixXd BoundingCage::mesh_vertices() {
     int num_vertices = this->num_keyframes()*4;
     Eigen::MatrixXd ret (num_vertices, 3);
 
-    int count = 0;
-    for (KeyFrame& kf : this->keyframes) {
-        Eigen::MatrixXd bbox_v = kf.bounding_box_vertices_3d();
-
-        ret.row(count++) = bbox_v.row(0);
-        ret.row(count++) = bbox_v.row(1);
-        ret.row(count++) = bbox_v.row(2);
-        ret.row(count++) = bbox_v.row(3);
+    Frame frame;
+    for (int i = 0; i < this->num_keyframes(); i++) {
+        frame_for_slot(i, frame);
+        ret.middleRows<4>(4*i) = frame.bounding_box_vertices_3d;
     }
 
     return ret;
@@ -746,8 +1233,9 @@ const Eigen::MatrixXi BoundingCage::mesh_faces() const {
 
 void BoundingCage::serialize(std::vector<char>& buffer) const {
     std::vector<BoundingCage::KeyFrame> kfs;
-    for (const BoundingCage::KeyFrame& kf : keyframes) {
-        kfs.push_back(kf);
+    kfs.reserve(num_keyframes());
+    for (const std::shared_ptr<KeyFrame>& kf : _keyframe_array.keyframes) {
+        kfs.push_back(*kf);
     }
     igl::serialize(kfs, "keyframes", buffer);
     igl::serialize(SV, "skeleton_vertices", buffer);
@@ -762,43 +1250,276 @@ void BoundingCage::deserialize(const std::vector<char>& buffer) {
     igl::deserialize(SV, "skeleton_vertices", buffer);
     igl::deserialize(SV_smooth, "smooth_skeleton_vertices", buffer);
     igl::deserialize(_keyframe_bounding_box, "keyframe_bbox", buffer);
+    keyframes.cage = this;
+    cells.cage = this;
+    _skeleton_frames.compute(SV_smooth);
 
     std::vector<std::shared_ptr<BoundingCage::KeyFrame>> kf_ptrs;
-    for (int i = 0; i < kfs.size(); i++) {
-        std::shared_ptr<BoundingCage::KeyFrame> kf(new BoundingCage::KeyFrame(kfs[i]));
-        kf->_cage = this;
-        kf_ptrs.push_back(kf);
-
+    kf_ptrs.reserve(kfs.size());
+    for (int i = 0; i < int(kfs.size()); i++) {
+        kf_ptrs.emplace_back(new BoundingCage::KeyFrame(kfs[i]));
     }
-    std::shared_ptr<BoundingCage::KeyFrame> front_kf = kf_ptrs.front();
-    std::shared_ptr<BoundingCage::KeyFrame> back_kf = kf_ptrs.back();
-    front_kf->_left_cell = std::shared_ptr<Cell>();
-    front_kf->_right_cell = std::shared_ptr<Cell>();
-    back_kf->_left_cell = std::shared_ptr<Cell>();
-    back_kf->_right_cell = std::shared_ptr<Cell>();
 
-    root = Cell::make_cell(front_kf, back_kf, this);
-    cells.head = root;
-    cells.tail = root;
-    keyframes.cage = this;
-    if (!root) {
-        logger->error("BoundingCage deserialize was unable to fit the first Cell");
+    if (!build_cells(kf_ptrs)) {
+        logger->error("BoundingCage deserialize was unable to rebuild the cage from {} keyframes", kf_ptrs.size());
         assert(false);
         exit(EXIT_FAILURE);
     }
-    cells.head = root;
-    cells.tail = cells.head;
-    _num_keyframes = 2;
+}
+
+bool BoundingCage::build_cells(const std::vector<std::shared_ptr<KeyFrame>>& kfs) {
+    // Validate the keyframes in one pass before touching the cage
+    if (kfs.size() < 2) {
+        logger->error("build_cells() needs at least 2 keyframes but got {}", kfs.size());
+        return false;
+    }
+    for (int i = 0; i < int(kfs.size()); i++) {
+        if (!kfs[i] || !std::isfinite(kfs[i]->index())) {
+            logger->error("build_cells() got a null keyframe or one with an invalid index at position {}", i);
+            return false;
+        }
+        if (i > 0 && !(kfs[i-1]->index() < kfs[i]->index())) {
+            logger->error("build_cells() keyframe indices are not strictly increasing at position {} ({} >= {})",
+                          i, kfs[i-1]->index(), kfs[i]->index());
+            return false;
+        }
+    }
 
-    for (int i = 1; i < kfs.size()-1; i++) {
-        std::shared_ptr<BoundingCage::KeyFrame> kf = kf_ptrs[i];
-        kf->_left_cell = kf_ptrs[i-1]->_right_cell;
-        kf->_right_cell = kf->_left_cell;
+    _keyframe_array.clear();
+    root.reset();
+    for (const std::shared_ptr<KeyFrame>& kf : kfs) {
         kf->_cage = this;
-        kf->_in_cage = false;
-        if (!split_internal(kf)) {
-            logger->error("BoundingCage deserialize failed to insert keyframe");
+        kf->logger = logger;
+        kf->_in_cage = true;
+    }
+
+    // Build a balanced tree over the keyframes, splitting every Cell at its middle keyframe. Cells are created
+    // in order, so the leaves come out sorted by index and the last Cells built around a keyframe are the leaves
+    // it bounds. Keyframe orientations are kept as they are instead of being parallel transported again.
+    std::vector<Cell*> leaves;
+    leaves.reserve(kfs.size() - 1);
+    std::function<std::shared_ptr<Cell>(int, int, std::weak_ptr<Cell>)> build_rec =
+            [&](int lo, int hi, std::weak_ptr<Cell> parent) -> std::shared_ptr<Cell> {
+        std::shared_ptr<Cell> cell = Cell::make_cell(kfs[lo], kfs[hi], this, parent);
+        if (hi - lo == 1) {
+            leaves.push_back(cell.get());
+        } else {
+            const int mid = lo + (hi - lo) / 2;
+            cell->_left_child = build_rec(lo, mid, cell);
+            cell->_right_child = build_rec(mid, hi, cell);
         }
+        return cell;
+    };
+    root = build_rec(0, int(kfs.size()) - 1, std::weak_ptr<Cell>());
+    _keyframe_array.assign(kfs, leaves, _skeleton_frames);
+    reset_history();
+
+    assert("Cell leaves out of order" && leaves.size() == kfs.size() - 1);
+    return true;
+}
+
+
+// |-----------------------------------| //
+// |                                   | //
+// | BoundingCage edit history methods | //
+// |                                   | //
+// |===================================| //
+
+void BoundingCage::keyframe_edited(int slot) {
+    _keyframe_array.update(slot, _skeleton_frames);
+    mark_edited(_keyframe_array.keyframes[slot]);
+}
+
+void BoundingCage::mark_edited(const std::shared_ptr<KeyFrame>& kf) {
+    if (!kf->_edited) {
+        kf->_edited = true;
+        _edited_keyframes.push_back(kf);
+    }
+}
+
+void BoundingCage::reset_history() {
+    _undo_steps.clear();
+    _redo_steps.clear();
+    for (const std::shared_ptr<KeyFrame>& kf : _edited_keyframes) {
+        kf->_edited = false;
+    }
+    _edited_keyframes.clear();
+    for (const std::shared_ptr<KeyFrame>& kf : _keyframe_array.keyframes) {
+        kf->_committed_state = kf->state();
     }
+    _committed_bounding_box = _keyframe_bounding_box;
 }
 
+bool BoundingCage::snapshot() {
+    EditStep step;
+    for (const std::shared_ptr<KeyFrame>& kf : _edited_keyframes) {
+        kf->_edited = false;
+        KeyFrameStatePtr before = kf->_committed_state;
+        KeyFrameStatePtr after = kf->in_bounding_cage() ? kf->state() : KeyFrameStatePtr();
+
+        // Skip KeyFrames which were edited back to where they started, or inserted and removed again
+        if (!before && !after) {
+            continue;
+        }
+        if (before && after && before->angle == after->angle && before->origin == after->origin &&
+                before->orientation == after->orientation && before->centroid_2d == after->centroid_2d) {
+            continue;
+        }
+
+        kf->_committed_state = after;
+        step.keyframes.emplace_back(before, after);
+    }
+    _edited_keyframes.clear();
+
+    step.bounding_box_before = _committed_bounding_box;
+    step.bounding_box_after = _keyframe_bounding_box;
+    _committed_bounding_box = _keyframe_bounding_box;
+
+    if (step.keyframes.empty() && step.bounding_box_before == step.bounding_box_after) {
+        return false;
+    }
+    _undo_steps.push_back(std::move(step));
+    _redo_steps.clear();
+    return true;
+}
+
+bool BoundingCage::undo() {
+    snapshot();
+    if (_undo_steps.empty()) {
+        return false;
+    }
+    EditStep step = std::move(_undo_steps.back());
+    _undo_steps.pop_back();
+    if (!apply_edit_step(step, false)) {
+        return false;
+    }
+    _redo_steps.push_back(std::move(step));
+    return true;
+}
+
+bool BoundingCage::redo() {
+    snapshot();
+    if (_redo_steps.empty()) {
+        return false;
+    }
+    EditStep step = std::move(_redo_steps.back());
+    _redo_steps.pop_back();
+    if (!apply_edit_step(step, true)) {
+        return false;
+    }
+    _undo_steps.push_back(std::move(step));
+    return true;
+}
+
+void BoundingCage::set_keyframe_state(KeyFrame& kf, const KeyFrameState& state) {
+    assert("Cannot restore a KeyFrame at a different index" && kf._index == state.index);
+    kf._angle = state.angle;
+    kf._origin = state.origin;
+    kf._orientation = state.orientation;
+    kf._centroid_2d = state.centroid_2d;
+    keyframe_edited(kf._slot);
+}
+
+bool BoundingCage::apply_edit_step(const EditStep& step, bool forward) {
+    // Find the KeyFrame in the cage with exactly the given index, or return an empty iterator if there is none
+    auto keyframe_at = [&](double index) -> KeyFrameIterator {
+        const int slot = _keyframe_array.upper_bound(index) - 1;
+        if (slot < 0 || _keyframe_array.indices[slot] != index) {
+            return KeyFrameIterator();
+        }
+        return KeyFrameIterator(_keyframe_array.keyframes[slot]);
+    };
+
+    // The cage was changed without going through the history, so none of the history can be applied
+    auto mismatch = [&](double index) -> bool {
+        logger->error("Edit history does not match the cage at index {}. Dropping the undo history.", index);
+        reset_history();
+        return false;
+    };
+
+    // Check the whole step against the cage before changing anything, so a mismatch leaves the cage as it was
+    std::vector<double> removed, inserted;
+    for (const std::pair<KeyFrameStatePtr, KeyFrameStatePtr>& change : step.keyframes) {
+        const KeyFrameStatePtr& from = forward ? change.first : change.second;
+        const KeyFrameStatePtr& to = forward ? change.second : change.first;
+        if (from && !to) {
+            KeyFrameIterator it = keyframe_at(from->index);
+            if (!it.in_bounding_cage() || it->is_endpoint()) {
+                return mismatch(from->index);
+            }
+            removed.push_back(from->index);
+        }
+    }
+    std::sort(removed.begin(), removed.end());
+    auto is_removed = [&](double index) -> bool {
+        return std::binary_search(removed.begin(), removed.end(), index);
+    };
+
+    for (const std::pair<KeyFrameStatePtr, KeyFrameStatePtr>& change : step.keyframes) {
+        const KeyFrameStatePtr& from = forward ? change.first : change.second;
+        const KeyFrameStatePtr& to = forward ? change.second : change.first;
+        if (!from && to) {
+            if (to->index <= min_index() || to->index >= max_index() ||
+                    (keyframe_at(to->index).in_bounding_cage() && !is_removed(to->index))) {
+                return mismatch(to->index);
+            }
+            inserted.push_back(to->index);
+        }
+    }
+    std::sort(inserted.begin(), inserted.end());
+    if (std::adjacent_find(inserted.begin(), inserted.end()) != inserted.end()) {
+        return mismatch(*std::adjacent_find(inserted.begin(), inserted.end()));
+    }
+
+    for (const std::pair<KeyFrameStatePtr, KeyFrameStatePtr>& change : step.keyframes) {
+        const KeyFrameStatePtr& from = forward ? change.first : change.second;
+        const KeyFrameStatePtr& to = forward ? change.second : change.first;
+        if (from && to) {
+            const bool kept = keyframe_at(to->index).in_bounding_cage() && !is_removed(to->index);
+            if (!kept && !std::binary_search(inserted.begin(), inserted.end(), to->index)) {
+                return mismatch(to->index);
+            }
+        }
+    }
+
+    // Remove KeyFrames first, so a KeyFrame which was removed and inserted again at the same index can be restored
+    for (const std::pair<KeyFrameStatePtr, KeyFrameStatePtr>& change : step.keyframes) {
+        const KeyFrameStatePtr& from = forward ? change.first : change.second;
+        const KeyFrameStatePtr& to = forward ? change.second : change.first;
+        if (from && !to) {
+            KeyFrameIterator it = keyframe_at(from->index);
+            const bool deleted = delete_keyframe(it);
+            assert("Checked KeyFrame could not be removed" && deleted);
+            (void) deleted;
+        }
+    }
+
+    for (const std::pair<KeyFrameStatePtr, KeyFrameStatePtr>& change : step.keyframes) {
+        const KeyFrameStatePtr& from = forward ? change.first : change.second;
+        const KeyFrameStatePtr& to = forward ? change.second : change.first;
+        if (!from && to) {
+            KeyFrameIterator it = insert_keyframe(to->index);
+            assert("Checked KeyFrame could not be inserted" && it.in_bounding_cage() && it->index() == to->index);
+            set_keyframe_state(*it, *to);
+        }
+    }
+
+    for (const std::pair<KeyFrameStatePtr, KeyFrameStatePtr>& change : step.keyframes) {
+        const KeyFrameStatePtr& from = forward ? change.first : change.second;
+        const KeyFrameStatePtr& to = forward ? change.second : change.first;
+        if (from && to) {
+            set_keyframe_state(*keyframe_at(to->index), *to);
+        }
+    }
+
+    _keyframe_bounding_box = forward ? step.bounding_box_after : step.bounding_box_before;
+    _committed_bounding_box = _keyframe_bounding_box;
+
+    // The cage now matches the target states, so they become the committed states without recording a new step
+    for (const std::shared_ptr<KeyFrame>& kf : _edited_keyframes) {
+        kf->_edited = false;
+        kf->_committed_state = kf->in_bounding_cage() ? kf->state() : KeyFrameStatePtr();
+    }
+    _edited_keyframes.clear();
+    return true;
+}
@@ -4,7 +4,9 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include <spdlog/spdlog.h>
 
@@ -28,6 +30,12 @@ private:
     ///
     std::shared_ptr<KeyFrame> split_internal(std::shared_ptr<KeyFrame> kf);
 
+    /// Build the cage from KeyFrames sorted by strictly increasing index in O(n).
+    /// The Cell tree is balanced and the KeyFrames are used as they are.
+    /// If the KeyFrames are invalid, this method returns false and the cage is unchanged.
+    ///
+    bool build_cells(const std::vector<std::shared_ptr<KeyFrame>>& kfs);
+
     /// Skeleton Vertices
     ///
     Eigen::MatrixXd SV;
@@ -41,8 +49,197 @@ private:
     /// By default this is the null logger
     std::shared_ptr<spdlog::logger> logger;
 
-    /// Number of keyframes in the bounding cage
-    int _num_keyframes = 0;
+    /// Rotation minimizing frames along SV_smooth, computed once per skeleton with the double reflection
+    /// method. Row i holds the frame at skeleton vertex i, whose normal is the skeleton tangent there,
+    /// and arc_lengths[i] is the distance along SV_smooth from the first vertex to vertex i.
+    ///
+    struct SkeletonFrames {
+        Eigen::MatrixXd tangents;
+        Eigen::MatrixXd rights;
+        Eigen::VectorXd arc_lengths;
+
+        /// rotations[i] takes the frame at vertex i to the frame at vertex i+1, so a query only interpolates
+        std::vector<Eigen::Quaterniond, Eigen::aligned_allocator<Eigen::Quaterniond>> rotations;
+
+        /// Get the rotation a fraction coeff of the way along rotations[i]
+        ///
+        Eigen::Quaterniond interpolate(int i, double coeff) const;
+
+        bool empty() const { return tangents.rows() < 2; }
+
+        /// Get the frame at skeleton vertex i
+        ///
+        Eigen::Matrix3d vertex_frame(int i) const;
+
+        /// Compute the frames along the polyline SV
+        ///
+        void compute(const Eigen::MatrixXd& SV);
+
+        /// Get the frame at a fractional skeleton index by rotating between the frames at
+        /// the vertices around it, so the torsion varies smoothly. Rows are right, up and normal.
+        ///
+        Eigen::Matrix3d frame(double index) const;
+
+        /// Get the frame at index carried to the plane with normal n and rotated by angle about n. This is the
+        /// same as twist(parallel_transport(frame(index), n), angle), composed as one rotation.
+        ///
+        Eigen::Matrix3d transported_frame(double index, const Eigen::RowVector3d& n, double angle) const;
+
+        /// Get the signed angle about its normal between a frame at index and the rotation minimizing
+        /// frame carried to its plane. This is 0 if there are no frames.
+        ///
+        double twist(double index, const Eigen::Matrix3d& orientation) const;
+
+        /// Get the distance along the skeleton from its first vertex to a fractional index
+        ///
+        double arc_length(double index) const;
+
+        /// Get the fractional index at a distance along the skeleton from its first vertex with
+        /// a binary search over arc_lengths. This inverts arc_length().
+        ///
+        double index_for_arc_length(double length) const;
+
+        void clear();
+    } _skeleton_frames;
+
+    /// The KeyFrames in the cage stored contiguously in index order. Entry i of each array
+    /// belongs to the i-th KeyFrame, and cells[i] is the leaf Cell between KeyFrames i and i+1.
+    /// The geometry mirrors the KeyFrame objects, so traversals, interpolation and export read
+    /// flat memory instead of chasing (and reference counting) pointers through the Cell tree.
+    ///
+    struct KeyFrameArray {
+        std::vector<double> indices;
+        std::vector<Eigen::RowVector3d> origins;
+        std::vector<Eigen::Matrix3d> orientations;
+        std::vector<Eigen::RowVector2d, Eigen::aligned_allocator<Eigen::RowVector2d>> centroids_2d;
+        std::vector<double> angles;
+
+        /// SkeletonFrames::twist() of each KeyFrame, so interpolating between two KeyFrames does not
+        /// carry the skeleton frames to both of them again on every query
+        std::vector<double> twists;
+
+        std::vector<std::shared_ptr<KeyFrame>> keyframes;
+        std::vector<Cell*> cells;
+
+        /// Arc length along the KeyFrame centroids up to each KeyFrame. Entries from depths_dirty_from
+        /// onwards are stale and get recomputed by the next query, so an edit only costs the KeyFrames after it.
+        mutable std::vector<double> depths;
+        mutable int depths_dirty_from = 0;
+        void invalidate_depths(int slot) { depths_dirty_from = std::min(depths_dirty_from, slot); }
+
+        int size() const { return int(indices.size()); }
+
+        /// Reset the array to the two endpoint KeyFrames bounding the Cell root
+        ///
+        void reset(const std::shared_ptr<KeyFrame>& front, const std::shared_ptr<KeyFrame>& back, Cell* root,
+                   const SkeletonFrames& frames);
+
+        /// Replace the array with the ordered KeyFrames kfs and the leaf Cells between them
+        ///
+        void assign(const std::vector<std::shared_ptr<KeyFrame>>& kfs, const std::vector<Cell*>& leaves,
+                    const SkeletonFrames& frames);
+
+        /// Insert kf at position slot, where the leaf Cell before it was split into left and right
+        ///
+        void insert(int slot, const std::shared_ptr<KeyFrame>& kf, Cell* left, Cell* right, const SkeletonFrames& frames);
+
+        /// Remove the KeyFrame at position slot together with the leaf Cell after it
+        ///
+        void erase(int slot);
+
+        /// Copy the geometry of the KeyFrame at position slot into the arrays
+        ///
+        void update(int slot, const SkeletonFrames& frames);
+
+        /// Return the position of the first KeyFrame whose index is greater than index
+        ///
+        int upper_bound(double index) const;
+
+        void clear();
+    } _keyframe_array;
+
+    /// The editable state of a KeyFrame when the last snapshot of the cage was taken. States are
+    /// immutable and shared by the KeyFrames and the edit history, so a snapshot only allocates
+    /// states for the KeyFrames which changed since the previous one.
+    ///
+    struct KeyFrameState {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        double index;
+        double angle;
+        Eigen::RowVector3d origin;
+        Eigen::Matrix3d orientation;
+        Eigen::RowVector2d centroid_2d;
+    };
+    typedef std::shared_ptr<const KeyFrameState> KeyFrameStatePtr;
+
+    /// One step of the edit history. Each entry of keyframes is the state of a KeyFrame before and after
+    /// the step, where a null state means the KeyFrame was not in the cage. KeyFrames are matched by their
+    /// index. The KeyFrame bounding box is shared by all the KeyFrames, so it is recorded once per step.
+    ///
+    struct EditStep {
+        typedef Eigen::Matrix<double, 4, 1, Eigen::DontAlign> BoundingBox;
+
+        std::vector<std::pair<KeyFrameStatePtr, KeyFrameStatePtr>> keyframes;
+        BoundingBox bounding_box_before;
+        BoundingBox bounding_box_after;
+    };
+    std::vector<EditStep> _undo_steps;
+    std::vector<EditStep> _redo_steps;
+
+    /// KeyFrame bounding box at the last snapshot
+    ///
+    Eigen::Vector4d _committed_bounding_box = Eigen::Vector4d::Zero();
+
+    /// KeyFrames which were changed, inserted or removed since the last snapshot
+    ///
+    std::vector<std::shared_ptr<KeyFrame>> _edited_keyframes;
+
+    /// Refresh the KeyFrame at position slot in the flat array after it was changed and record the edit
+    ///
+    void keyframe_edited(int slot);
+
+    /// Record that kf changed since the last snapshot
+    ///
+    void mark_edited(const std::shared_ptr<KeyFrame>& kf);
+
+    /// Drop the edit history and make the current cage the committed state of every KeyFrame
+    ///
+    void reset_history();
+
+    /// Undo (forward is false) or redo (forward is true) a step of the edit history.
+    /// If the step does not match the KeyFrames in the cage, the cage is left unchanged, the history is dropped
+    /// and this returns false.
+    ///
+    bool apply_edit_step(const EditStep& step, bool forward);
+
+    /// Overwrite the geometry of a KeyFrame in the cage with a saved state
+    ///
+    void set_keyframe_state(KeyFrame& kf, const KeyFrameState& state);
+
+public:
+    struct Frame;
+private:
+
+    /// Get the Frame of the KeyFrame at position slot in the flat array
+    ///
+    void frame_for_slot(int slot, Frame& frame) const;
+
+    /// Get the 3d centroid of the KeyFrame at position slot in the flat array
+    ///
+    Eigen::RowVector3d centroid_3d(int slot) const {
+        const Eigen::Matrix3d& R = _keyframe_array.orientations[slot];
+        const Eigen::RowVector2d& c = _keyframe_array.centroids_2d[slot];
+        return _keyframe_array.origins[slot] + R.row(0)*c[0] + R.row(1)*c[1];
+    }
+
+    /// Neighbors of a KeyFrame or Cell in index order, or nullptr if there is none. A KeyFrame which
+    /// is not in the cage is located by its index.
+    ///
+    KeyFrame* keyframe_after(const KeyFrame* kf) const;
+    KeyFrame* keyframe_before(const KeyFrame* kf) const;
+    Cell* cell_after(const Cell* cell) const;
+    Cell* cell_before(const Cell* cell) const;
 
     Eigen::Vector4d _keyframe_bounding_box;
 
@@ -52,6 +249,9 @@ public:
         return _keyframe_bounding_box;
     }
 
+    /// Set the bounding box of every KeyFrame. Changes are recorded in the edit history
+    /// like KeyFrame edits.
+    ///
     bool set_keyframe_bounding_box(const Eigen::Vector4d& bbox) {
         if (bbox[0] >= bbox[1] || bbox[2] >= bbox[3]) {
             logger->error("Invalid intial bounding box. The input is (min_u, max_u, min_v, max_v) = ({}, {}, {}, {})."
@@ -133,30 +333,30 @@ public:
         const Eigen::MatrixXi mesh_faces() const;
         const Eigen::MatrixXd mesh_vertices() const;
 
-        const KeyFrameIterator left_keyframe() const { return KeyFrameIterator(_left_keyframe); }
-        const KeyFrameIterator right_keyframe() const { return KeyFrameIterator(_right_keyframe); }
+        const KeyFrameIterator left_keyframe() const { return KeyFrameIterator(_left_keyframe.get()); }
+        const KeyFrameIterator right_keyframe() const { return KeyFrameIterator(_right_keyframe.get()); }
         double min_index() const { return _left_keyframe->index(); }
         double max_index() const { return _right_keyframe->index(); }
     };
 
-    /// Bidirectional Iterator class used to traverse the linked list of leaf Cells
-    /// in KeyFrame-index order.
+    /// Bidirectional Iterator class used to traverse the leaf Cells in KeyFrame-index order.
+    /// This is a view into the flat KeyFrame array of the cage.
     ///
     class CellIterator {
         friend class BoundingCage;
 
-        std::shared_ptr<Cell> cell;
+        Cell* cell;
 
-        CellIterator(std::shared_ptr<Cell> c) : cell(c) {}
+        CellIterator(Cell* c) : cell(c) {}
 
     public:
         CellIterator(const CellIterator& other) : cell(other.cell) {}
-        CellIterator() : cell(std::shared_ptr<Cell>()) {}
+        CellIterator() : cell(nullptr) {}
         CellIterator& operator=(const CellIterator& other) { cell = other.cell; return *this; }
 
         CellIterator operator++() {
-            if (cell && cell->_right_keyframe) {
-                cell = cell->_right_keyframe->_right_cell.lock();
+            if (cell) {
+                cell = cell->_cage->cell_after(cell);
             }
             return *this;
         }
@@ -166,8 +366,8 @@ public:
         }
 
         CellIterator operator--() {
-            if (cell && cell->_left_keyframe) {
-                cell = cell->_left_keyframe->_left_cell.lock();
+            if (cell) {
+                cell = cell->_cage->cell_before(cell);
             }
             return *this;
         }
@@ -183,7 +383,7 @@ public:
         bool operator!=(const CellIterator& other) const {
             return cell != other.cell;
         }
-        std::shared_ptr<Cell> operator->() {
+        Cell* operator->() {
             return cell;
         }
 
@@ -192,37 +392,29 @@ public:
         }
     };
 
-    /// Linked list of Cell prisms which make up the bounding cage.
+    /// List of Cell prisms which make up the bounding cage.
     /// These correspond to the keyframe-index ordered leaf nodes of the Cell tree.
     ///
     class Cells {
         friend class BoundingCage;
 
-        std::shared_ptr<Cell> head;
-        std::shared_ptr<Cell> tail;
+        const BoundingCage* cage;
     public:
-        CellIterator begin() const { return CellIterator(head); }
+        CellIterator begin() const {
+            const std::vector<Cell*>& c = cage->_keyframe_array.cells;
+            return c.empty() ? CellIterator() : CellIterator(c.front());
+        }
         CellIterator end() const { return CellIterator(); }
-        CellIterator rbegin() const { return CellIterator(tail); }
+        CellIterator rbegin() const {
+            const std::vector<Cell*>& c = cage->_keyframe_array.cells;
+            return c.empty() ? CellIterator() : CellIterator(c.back());
+        }
         CellIterator rend() const { return CellIterator(); }
     } cells;
 
-    class KeyFrame {
+    class KeyFrame : public std::enable_shared_from_this<KeyFrame> {
         friend class BoundingCage;
 
-        /// Parallel transport constructor:
-        /// The local coordinate frame in this KeyFrame is determined
-        /// by transporting the frame from from_kf
-        ///
-        KeyFrame(const Eigen::RowVector3d& normal,
-                 const Eigen::RowVector3d& center,
-                 const BoundingCage::KeyFrame& from_kf, const double angle,
-                 const Eigen::MatrixXd& pts,
-                 const Eigen::RowVector2d& centroid,
-                 std::shared_ptr<BoundingCage::Cell> cell,
-                 double idx,
-                 BoundingCage* cage);
-
         /// Explicit constructor:
         /// The local coordinate frame for this KeyFrame is provided explicitly
         ///
@@ -255,12 +447,26 @@ public:
         /// True if this keyframe is part of the bounding cage
         bool _in_cage = false;
 
+        /// Position of this keyframe in the flat keyframe array of the cage.
+        /// This is only valid while the keyframe is part of the cage.
+        int _slot = -1;
+
         /// The index of this KeyFrame.
         double _index;
 
         /// Store a torsion angle from -pi/2 to pi/2 radians which we use to interpolate
         double _angle = 0.0;
 
+        /// State of this KeyFrame at the last snapshot of the cage, or null if it was not in the cage.
+        /// _edited is set while the KeyFrame is in the list of edits since that snapshot.
+        ///
+        KeyFrameStatePtr _committed_state;
+        bool _edited = false;
+
+        /// Copy the editable state of this KeyFrame
+        ///
+        KeyFrameStatePtr state() const;
+
         /// Pointers to the Cells bounidng this keyframe
         ///
         std::weak_ptr<Cell> _left_cell;
@@ -290,7 +496,7 @@ public:
         /// True if this KeyFrame is at one of the endpoints of its BoundingCage
         ///
         bool is_endpoint() const {
-            return in_bounding_cage() && (!left_cell() || !right_cell());
+            return in_bounding_cage() && (_slot == 0 || _slot == _cage->num_keyframes()-1);
         }
 
         /// Get the normal of the plane of this KeyFrame.
@@ -468,32 +674,54 @@ public:
         bool set_angle(double angle);
     };
 
-    /// Bidirectional Iterator class used to traverse the linked list of KeyFrames
-    /// in index order.
+    /// Bidirectional Iterator class used to traverse the KeyFrames in index order.
+    /// This is a view into the flat KeyFrame array of the cage. An iterator to a KeyFrame
+    /// which is not in the cage (e.g. one returned by keyframe_for_index()) owns it, and
+    /// stepping from it moves to the neighboring KeyFrames in the cage.
     ///
     class KeyFrameIterator {
         friend class BoundingCage;
 
-        std::shared_ptr<KeyFrame> keyframe;
+        KeyFrame* keyframe;
+
+        /// Keeps a KeyFrame which is not owned by the cage, or a pinned KeyFrame, alive
+        std::shared_ptr<KeyFrame> detached;
 
-        KeyFrameIterator(std::shared_ptr<KeyFrame> kf) : keyframe(kf) {}
+        KeyFrameIterator(KeyFrame* kf) : keyframe(kf) {}
+        KeyFrameIterator(const std::shared_ptr<KeyFrame>& kf) : keyframe(kf.get()) {
+            if (kf && !kf->in_bounding_cage()) {
+                detached = kf;
+            }
+        }
 
     public:
-        KeyFrameIterator(const KeyFrameIterator& other) : keyframe(other.keyframe) {}
-        KeyFrameIterator() : keyframe(std::shared_ptr<KeyFrame>()) {}
-        KeyFrameIterator& operator=(const KeyFrameIterator& other) { if (&other != this) { keyframe = other.keyframe; } return *this; }
+        KeyFrameIterator(const KeyFrameIterator& other) : keyframe(other.keyframe), detached(other.detached) {}
+        KeyFrameIterator() : keyframe(nullptr) {}
+        KeyFrameIterator& operator=(const KeyFrameIterator& other) {
+            if (&other != this) { keyframe = other.keyframe; detached = other.detached; }
+            return *this;
+        }
+
+        /// Return an iterator which also owns its KeyFrame, so it stays valid if the cage removes
+        /// the KeyFrame in delete_keyframe(), undo() or redo(). Use this for iterators which are kept
+        /// across edits, and check in_bounding_cage() before editing through them. Stepping the
+        /// returned iterator makes it a plain view again.
+        ///
+        KeyFrameIterator pinned() const {
+            KeyFrameIterator ret(*this);
+            if (keyframe && !ret.detached) {
+                ret.detached = keyframe->shared_from_this();
+            }
+            return ret;
+        }
 
         KeyFrameIterator operator++() {
             if (!keyframe) {
                 return *this;
             }
 
-            std::shared_ptr<Cell> right_cell = keyframe->_right_cell.lock();
-            if (keyframe && right_cell) {
-                keyframe = right_cell->_right_keyframe;
-            } else if(!right_cell) {
-                keyframe.reset();
-            }
+            keyframe = keyframe->_cage->keyframe_after(keyframe);
+            detached.reset();
             return *this;
         }
 
@@ -506,12 +734,8 @@ public:
                 return *this;
             }
 
-            std::shared_ptr<Cell> left_cell = keyframe->_left_cell.lock();
-            if (keyframe && left_cell) {
-                keyframe = left_cell->_left_keyframe;
-            } else if(!left_cell) {
-                keyframe.reset();
-            }
+            keyframe = keyframe->_cage->keyframe_before(keyframe);
+            detached.reset();
             return *this;
         }
 
@@ -519,6 +743,12 @@ public:
             return operator--();
         }
 
+        /// True if the iterator points at a KeyFrame which is currently part of the cage
+        ///
+        bool in_bounding_cage() const {
+            return keyframe && keyframe->in_bounding_cage();
+        }
+
         bool operator==(const KeyFrameIterator& other) const {
             return keyframe == other.keyframe;
         }
@@ -527,7 +757,7 @@ public:
             return keyframe != other.keyframe;
         }
 
-        std::shared_ptr<KeyFrame> operator->() const {
+        KeyFrame* operator->() const {
             return keyframe;
         }
 
@@ -536,8 +766,8 @@ public:
         }
     };
 
-    /// Linked list of KeyFrames ordered by index.
-    /// This list is built upon the Cell leaf-list described above.
+    /// List of KeyFrames ordered by index.
+    /// This is a view into the flat KeyFrame array of the cage.
     ///
     class KeyFrames {
         friend class BoundingCage;
@@ -546,11 +776,8 @@ public:
 
     public:
         KeyFrameIterator begin() const {
-            if(cage->cells.head) {
-                return KeyFrameIterator(cage->cells.head->_left_keyframe);
-            } else {
-                return KeyFrameIterator();
-            }
+            const std::vector<std::shared_ptr<KeyFrame>>& kfs = cage->_keyframe_array.keyframes;
+            return kfs.empty() ? KeyFrameIterator() : KeyFrameIterator(kfs.front().get());
         }
 
         KeyFrameIterator end() const {
@@ -558,11 +785,8 @@ public:
         }
 
         KeyFrameIterator rbegin() const {
-            if(cage->cells.tail) {
-                return KeyFrameIterator(cage->cells.tail->_right_keyframe);
-            } else {
-                return KeyFrameIterator();
-            }
+            const std::vector<std::shared_ptr<KeyFrame>>& kfs = cage->_keyframe_array.keyframes;
+            return kfs.empty() ? KeyFrameIterator() : KeyFrameIterator(kfs.back().get());
         }
 
         KeyFrameIterator rend() const {
@@ -574,6 +798,7 @@ public:
 
     BoundingCage() {
         keyframes.cage = this;
+        cells.cage = this;
     }
 
     void set_logger(std::shared_ptr<spdlog::logger> logger) {
@@ -584,23 +809,22 @@ public:
     friend class Cell;
 
     const int num_keyframes() const {
-        return _num_keyframes;
+        return _keyframe_array.size();
     }
 
     const int num_cells() const {
-        return _num_keyframes - 1;
+        return num_keyframes() - 1;
     }
 
-    const void keyframe_depths(std::vector<double>& out_depths) {
-        out_depths.reserve(num_keyframes());
-        out_depths.clear();
-        Eigen::RowVector3d last_centroid = keyframes.begin()->centroid_3d();
-        double total_dist = 0.0;
-        for (const BoundingCage::KeyFrame& kf : keyframes) {
-            total_dist += (kf.centroid_3d() - last_centroid).norm();
-            last_centroid = kf.centroid_3d();
-            out_depths.push_back(total_dist);
-        }
+    /// Get the distance along the keyframe centroids from the first keyframe to each keyframe.
+    /// The table is cached and only the part after the first edited keyframe is recomputed.
+    ///
+    const std::vector<double>& keyframe_depths() const;
+
+    /// Get the distance along the keyframe centroids from the first to the last keyframe
+    ///
+    double cage_length() const {
+        return num_keyframes() > 0 ? keyframe_depths().back() : 0.0;
     }
 
     void serialize(std::vector<char>& buffer) const;
@@ -610,19 +834,60 @@ public:
     /// There must be at least two vertices, if not the method returns false.
     /// Upon setting the vertices, The
     ///
+    /// The skeleton is smoothed with one implicit Laplacian solve which keeps its
+    /// endpoints fixed. Larger smoothing_stiffness gives a smoother skeleton and
+    /// zero leaves it as it is.
+    ///
+    /// If simplification_tolerance is positive, Cells are split at the vertices of
+    /// the smoothed skeleton simplified to within that distance of the full one,
+    /// so KeyFrames are concentrated where the skeleton bends. The Cells are
+    /// still fit to contain every vertex of the full skeleton.
+    ///
     bool set_skeleton_vertices(const Eigen::MatrixXd& new_SV,
-                               unsigned smoothing_iters,
-                               const Eigen::Vector4d& bounding_box);
+                               double smoothing_stiffness,
+                               const Eigen::Vector4d& bounding_box,
+                               double simplification_tolerance = 0.0);
 
     /// Clear the bounding cage and skeleton vertices
     ///
     void clear() {
-        _num_keyframes = 0;
+        _keyframe_array.clear();
         root.reset();
-        cells.head.reset();
-        cells.tail.reset();
         SV.resize(0, 0);
         SV_smooth.resize(0, 0);
+        _skeleton_frames.clear();
+        reset_history();
+    }
+
+    /// Record the edits made since the last snapshot as one step of the undo history.
+    /// Only the KeyFrames which changed are copied, the rest are shared with earlier snapshots.
+    /// This clears the redo history. Returns false if nothing changed.
+    ///
+    bool snapshot();
+
+    /// Revert the last step of the undo history, taking a snapshot of any pending edits first.
+    /// Returns false if there is nothing to undo, or if the history no longer matches the cage,
+    /// in which case the history is dropped.
+    ///
+    bool undo();
+
+    /// Reapply the last undone step. Returns false if there is nothing to redo, or if the history
+    /// no longer matches the cage, in which case the history is dropped.
+    ///
+    bool redo();
+
+    bool can_undo() const {
+        return !_undo_steps.empty() || has_pending_edits();
+    }
+
+    bool can_redo() const {
+        return !_redo_steps.empty() && !has_pending_edits();
+    }
+
+    /// True if the cage was edited since the last snapshot
+    ///
+    bool has_pending_edits() const {
+        return !_edited_keyframes.empty() || _keyframe_bounding_box != _committed_bounding_box;
     }
 
     /// Add a new KeyFrame at the given index in the bounding Cage.
@@ -642,6 +907,20 @@ public:
     const Eigen::MatrixXd& skeleton_vertices() const { return SV; }
     const Eigen::MatrixXd& smooth_skeleton_vertices() const { return SV_smooth; }
 
+    /// Get the rotation minimizing frame of the smoothed skeleton at a (fractional) index.
+    /// Rows are the right, up and normal directions, and the normal is the skeleton tangent.
+    ///
+    Eigen::Matrix3d skeleton_frame(double index) const { return _skeleton_frames.frame(index); }
+
+    /// Get the distance along the smoothed skeleton from its first vertex to a (fractional) index
+    ///
+    double skeleton_arc_length(double index) const { return _skeleton_frames.arc_length(index); }
+
+    /// Get the (fractional) index at a distance along the smoothed skeleton from its first vertex in O(log n).
+    /// This is the inverse of skeleton_arc_length().
+    ///
+    double skeleton_index_for_arc_length(double length) const { return _skeleton_frames.index_for_arc_length(length); }
+
     /// Get a buffer of vertices for the mesh of the BoundingCage
     /// To get the faces, iterate over the cells and call mesh_faces for each cell.
     /// Each cell's face buffer indexes into mesh_vertices()
@@ -655,7 +934,7 @@ public:
         if(!root) {
             return 0.0;
         }
-        assert(root->min_index() == cells.head->min_index());
+        assert(root->min_index() == _keyframe_array.indices.front());
         return root->min_index();
     }
 
@@ -665,15 +944,56 @@ public:
         if(!root) {
             return 0.0;
         }
-        assert(root->max_index() == cells.tail->max_index());
+        assert(root->max_index() == _keyframe_array.indices.back());
         return root->max_index();
     }
 
     /// Get a KeyFrame at the specified index.
     /// The KeyFrame may not yet be inserted into the bounding cage.
     /// To insert it, call split()
+    /// The Cell containing the index is found with a binary search over the KeyFrame indices.
     ///
     KeyFrameIterator keyframe_for_index(double index) const;
+
+    /// The cross section of the cage at some index. This holds the same geometry as the KeyFrame
+    /// returned by keyframe_for_index(), without allocating one.
+    ///
+    struct Frame {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        double index;
+        double angle;
+
+        Eigen::RowVector3d origin;
+
+        /// Rows are the right, up and normal directions without the torsion rotation
+        Eigen::Matrix3d orientation;
+
+        /// Right and up directions with the torsion rotation applied
+        Eigen::RowVector3d right_rotated;
+        Eigen::RowVector3d up_rotated;
+
+        Eigen::RowVector2d centroid_2d;
+        Eigen::RowVector3d centroid_3d;
+
+        /// Corners of the keyframe bounding box in the same order as
+        /// KeyFrame::bounding_box_vertices_3d()
+        Eigen::Matrix<double, 4, 3> bounding_box_vertices_3d;
+    };
+    typedef std::vector<Frame, Eigen::aligned_allocator<Frame>> Frames;
+
+    /// Compute the Frame at the specified index from the two KeyFrames around it.
+    /// The plane normal comes from the diagonals of the interpolated bounding box,
+    /// so no SVD or heap allocation is needed. The in-plane axes follow the rotation minimizing
+    /// frame of the skeleton, twisted to match the KeyFrames at both ends of the Cell, so they do
+    /// not depend on the order KeyFrames were inserted in. Returns false if index is outside the cage.
+    ///
+    bool frame_for_index(double index, Frame& frame) const;
+
+    /// Compute the Frames at many indices in parallel.
+    /// Indices outside the cage are clamped to [min_index(), max_index()].
+    ///
+    void frames_for_indices(const Eigen::VectorXd& indices, Frames& frames) const;
 };
 
 namespace igl {
@@ -0,0 +1,107 @@
+#include "conjugate_gradient.h"
+
+#include <igl/parallel_for.h>
+
+#include <cmath>
+
+
+namespace {
+
+constexpr size_t MIN_PARALLEL_ROWS = 10000;
+
+// y = A x restricted to the rows which are not fixed. Fixed rows of y are set to zero.
+void masked_product(const RowMajorSparseMatrixXd& A, const Eigen::VectorXd& x, const std::vector<char>& fixed,
+                    Eigen::VectorXd& y) {
+    const int* outer = A.outerIndexPtr();
+    const int* inner = A.innerIndexPtr();
+    const double* values = A.valuePtr();
+    igl::parallel_for(A.rows(), [&](const int i) {
+        if (!fixed.empty() && fixed[i]) {
+            y[i] = 0.0;
+            return;
+        }
+        double sum = 0.0;
+        for (int k = outer[i]; k < outer[i + 1]; k++) {
+            sum += values[k] * x[inner[k]];
+        }
+        y[i] = sum;
+    }, MIN_PARALLEL_ROWS);
+}
+
+double parallel_dot(const Eigen::VectorXd& a, const Eigen::VectorXd& b) {
+    std::vector<double> partial_sums;
+    double sum = 0.0;
+    igl::parallel_for(a.size(),
+        [&](const size_t num_threads) { partial_sums.assign(num_threads, 0.0); },
+        [&](const int i, const size_t thread_id) { partial_sums[thread_id] += a[i] * b[i]; },
+        [&](const size_t thread_id) { sum += partial_sums[thread_id]; },
+        MIN_PARALLEL_ROWS);
+    return sum;
+}
+
+} // namespace
+
+
+ConjugateGradientResult conjugate_gradient(const RowMajorSparseMatrixXd& A,
+                                           const Eigen::VectorXd& b,
+                                           const std::vector<char>& fixed,
+                                           Eigen::VectorXd& x,
+                                           int max_iterations,
+                                           double tolerance) {
+    using namespace Eigen;
+
+    const int n = A.rows();
+    const auto is_fixed = [&](int i) { return !fixed.empty() && fixed[i]; };
+    ConjugateGradientResult result;
+
+    VectorXd inv_diagonal = A.diagonal();
+    igl::parallel_for(n, [&](const int i) {
+        inv_diagonal[i] = (is_fixed(i) || inv_diagonal[i] == 0.0) ? 0.0 : 1.0 / inv_diagonal[i];
+    }, MIN_PARALLEL_ROWS);
+
+    // The constrained values move to the right hand side, so the tolerance is relative to b - A_fc x_c
+    VectorXd r(n), z(n), p(n), q(n);
+    igl::parallel_for(n, [&](const int i) { p[i] = is_fixed(i) ? x[i] : 0.0; }, MIN_PARALLEL_ROWS);
+    masked_product(A, p, fixed, q);
+    igl::parallel_for(n, [&](const int i) { r[i] = is_fixed(i) ? 0.0 : b[i] - q[i]; }, MIN_PARALLEL_ROWS);
+    const double rhs_norm = std::sqrt(parallel_dot(r, r));
+    if (rhs_norm == 0.0) {
+        igl::parallel_for(n, [&](const int i) { if (!is_fixed(i)) x[i] = 0.0; }, MIN_PARALLEL_ROWS);
+        result.converged = true;
+        return result;
+    }
+
+    masked_product(A, x, fixed, q);
+    igl::parallel_for(n, [&](const int i) {
+        r[i] = is_fixed(i) ? 0.0 : b[i] - q[i];
+        z[i] = inv_diagonal[i] * r[i];
+        p[i] = z[i];
+    }, MIN_PARALLEL_ROWS);
+
+    double rz = parallel_dot(r, z);
+    result.residual = std::sqrt(parallel_dot(r, r)) / rhs_norm;
+    while (result.residual > tolerance && result.iterations < max_iterations) {
+        masked_product(A, p, fixed, q);
+        const double pq = parallel_dot(p, q);
+        if (pq <= 0.0) {
+            break;
+        }
+        const double alpha = rz / pq;
+        igl::parallel_for(n, [&](const int i) {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+            z[i] = inv_diagonal[i] * r[i];
+        }, MIN_PARALLEL_ROWS);
+
+        const double rz_next = parallel_dot(r, z);
+        const double beta = rz_next / rz;
+        rz = rz_next;
+        igl::parallel_for(n, [&](const int i) { p[i] = z[i] + beta * p[i]; }, MIN_PARALLEL_ROWS);
+
+        result.iterations += 1;
+        result.residual = std::sqrt(parallel_dot(r, r)) / rhs_norm;
+    }
+
+    result.converged = result.residual <= tolerance;
+    return result;
+}
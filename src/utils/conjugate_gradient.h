@@ -0,0 +1,35 @@
+#ifndef CONJUGATE_GRADIENT_H
+#define CONJUGATE_GRADIENT_H
+
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+
+#include <vector>
+
+
+typedef Eigen::SparseMatrix<double, Eigen::RowMajor> RowMajorSparseMatrixXd;
+
+struct ConjugateGradientResult {
+    int iterations = 0;
+
+    // Residual norm relative to the norm of the right hand side
+    double residual = 0.0;
+
+    bool converged = false;
+};
+
+
+// Solve A x = b with Jacobi preconditioned conjugate gradients, where A is symmetric positive semi-definite and
+// the system is consistent. The matrix products and dot products run in parallel over the rows of A, and the
+// solver only allocates a handful of vectors of the size of b.
+//
+// x is used as the initial guess. Entries i with fixed[i] != 0 are Dirichlet constraints: they keep their value
+// in x and their rows are dropped from the system. fixed may be empty if there are no constraints.
+ConjugateGradientResult conjugate_gradient(const RowMajorSparseMatrixXd& A,
+                                           const Eigen::VectorXd& b,
+                                           const std::vector<char>& fixed,
+                                           Eigen::VectorXd& x,
+                                           int max_iterations,
+                                           double tolerance);
+
+#endif // CONJUGATE_GRADIENT_H
@@ -0,0 +1,418 @@
+#include "decimate_surface.h"
+
+#include <Eigen/Geometry>
+#include <Eigen/LU>
+#include <igl/get_seconds.h>
+#include <igl/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+
+namespace {
+
+// Minimum cosine between a triangle normal before and after a collapse
+constexpr double MIN_NORMAL_COSINE = 0.3;
+
+// Upper bound on the number of collapse rounds
+constexpr int MAX_ROUNDS = 100;
+
+// Sum of squared distances to a set of planes: E(x) = x^T A x + 2 b^T x + c
+struct Quadric {
+    Eigen::Matrix3d A = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d b = Eigen::Vector3d::Zero();
+    double c = 0.0;
+
+    void add_plane(const Eigen::Vector3d& n, double d) {
+        A += n * n.transpose();
+        b += d * n;
+        c += d * d;
+    }
+
+    Quadric operator+(const Quadric& other) const {
+        Quadric ret;
+        ret.A = A + other.A;
+        ret.b = b + other.b;
+        ret.c = c + other.c;
+        return ret;
+    }
+
+    double evaluate(const Eigen::Vector3d& x) const {
+        return std::max(x.dot(A * x) + 2.0 * b.dot(x) + c, 0.0);
+    }
+};
+
+// Mutable triangle mesh with vertex to face incidence used while collapsing edges
+struct CollapseMesh {
+    std::vector<Eigen::Vector3d> V;
+    std::vector<std::array<int, 3>> F;
+    std::vector<char> face_alive;
+    std::vector<std::vector<int>> VF;
+    std::vector<Quadric> Q;
+    std::vector<char> locked;
+};
+
+struct Edge {
+    int a, b;
+    double cost;
+    Eigen::Vector3d target;
+};
+
+inline bool face_contains(const std::array<int, 3>& f, int v) {
+    return f[0] == v || f[1] == v || f[2] == v;
+}
+
+inline int face_index_of(const std::array<int, 3>& f, int v) {
+    return f[0] == v ? 0 : (f[1] == v ? 1 : 2);
+}
+
+inline Eigen::Vector3d face_normal(const Eigen::Vector3d& p0, const Eigen::Vector3d& p1, const Eigen::Vector3d& p2) {
+    return (p1 - p0).cross(p2 - p0);
+}
+
+// Sorted list of the vertices adjacent to v
+void vertex_neighbors(const CollapseMesh& mesh, int v, std::vector<int>& out) {
+    out.clear();
+    for (int f : mesh.VF[v]) {
+        for (int k = 0; k < 3; k++) {
+            if (mesh.F[f][k] != v) {
+                out.push_back(mesh.F[f][k]);
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+// Check that every directed half-edge appears once and has an opposite twin
+bool is_closed_oriented_manifold(const Eigen::MatrixXi& F, int num_vertices) {
+    std::vector<uint64_t> half_edges;
+    half_edges.reserve(3 * F.rows());
+    for (int i = 0; i < F.rows(); i++) {
+        for (int k = 0; k < 3; k++) {
+            const int u = F(i, k), v = F(i, (k + 1) % 3);
+            if (u < 0 || u >= num_vertices || u == v) {
+                return false;
+            }
+            half_edges.push_back((uint64_t(u) << 32) | uint64_t(v));
+        }
+    }
+    std::sort(half_edges.begin(), half_edges.end());
+    if (std::adjacent_find(half_edges.begin(), half_edges.end()) != half_edges.end()) {
+        return false;
+    }
+    for (uint64_t he : half_edges) {
+        const uint64_t twin = (he << 32) | (he >> 32);
+        if (!std::binary_search(half_edges.begin(), half_edges.end(), twin)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A vertex is collapsible only if its incident faces form a single fan
+bool is_manifold_vertex(const CollapseMesh& mesh, int v) {
+    const std::vector<int>& faces = mesh.VF[v];
+    if (faces.size() < 3) {
+        return false;
+    }
+
+    int current = faces[0];
+    size_t visited = 0;
+    do {
+        const std::array<int, 3>& f = mesh.F[current];
+        const int w = f[(face_index_of(f, v) + 1) % 3];
+        int next = -1;
+        for (int g : faces) {
+            const std::array<int, 3>& fg = mesh.F[g];
+            if (g != current && fg[(face_index_of(fg, v) + 2) % 3] == w) {
+                next = g;
+                break;
+            }
+        }
+        if (next < 0) {
+            return false;
+        }
+        current = next;
+        visited += 1;
+    } while (current != faces[0] && visited <= faces.size());
+
+    return visited == faces.size();
+}
+
+// Cost and optimal position of collapsing the edge (a, b)
+void edge_cost(const CollapseMesh& mesh, Edge& e) {
+    const Quadric q = mesh.Q[e.a] + mesh.Q[e.b];
+    const Eigen::Vector3d& pa = mesh.V[e.a];
+    const Eigen::Vector3d& pb = mesh.V[e.b];
+    const Eigen::Vector3d mid = 0.5 * (pa + pb);
+    const double edge_length = (pb - pa).norm();
+
+    // Use the minimizer of the quadric if it is well defined and close to the edge
+    const double scale = q.A.trace() / 3.0;
+    Eigen::Matrix3d A_inv;
+    double det;
+    bool invertible;
+    q.A.computeInverseAndDetWithCheck(A_inv, det, invertible);
+    if (invertible && std::abs(det) > 1e-6 * scale * scale * scale) {
+        const Eigen::Vector3d x = -A_inv * q.b;
+        if ((x - mid).norm() <= edge_length) {
+            e.target = x;
+            e.cost = q.evaluate(x);
+            return;
+        }
+    }
+
+    // Otherwise pick the best of the endpoints and the midpoint
+    const std::array<const Eigen::Vector3d*, 3> candidates = {{ &pa, &pb, &mid }};
+    e.cost = std::numeric_limits<double>::infinity();
+    for (const Eigen::Vector3d* c : candidates) {
+        const double cost = q.evaluate(*c);
+        if (cost < e.cost) {
+            e.cost = cost;
+            e.target = *c;
+        }
+    }
+}
+
+// Collapse the edge (a, b) into a at position x. Returns false if the collapse would change the topology
+// of the mesh or flip a triangle, in which case the mesh is not modified.
+bool try_collapse(CollapseMesh& mesh, int a, int b, const Eigen::Vector3d& x) {
+    // The edge must be shared by exactly two faces
+    std::array<int, 2> opposite;
+    int num_shared = 0;
+    for (int f : mesh.VF[a]) {
+        if (face_contains(mesh.F[f], b)) {
+            if (num_shared < 2) {
+                const std::array<int, 3>& face = mesh.F[f];
+                opposite[num_shared] = face[0] != a && face[0] != b ? face[0] : (face[1] != a && face[1] != b ? face[1] : face[2]);
+            }
+            num_shared += 1;
+        }
+    }
+    if (num_shared != 2) {
+        return false;
+    }
+
+    // Link condition: the only common neighbors of a and b are the two opposite vertices
+    std::vector<int> na, nb, common;
+    vertex_neighbors(mesh, a, na);
+    vertex_neighbors(mesh, b, nb);
+    std::set_intersection(na.begin(), na.end(), nb.begin(), nb.end(), std::back_inserter(common));
+    if (common.size() != 2) {
+        return false;
+    }
+
+    // Opposite vertices lose a face, don't let them become degenerate
+    if (mesh.VF[opposite[0]].size() <= 3 || mesh.VF[opposite[1]].size() <= 3) {
+        return false;
+    }
+
+    // Reject collapses which flip or degenerate one of the remaining faces
+    for (int v : { a, b }) {
+        for (int f : mesh.VF[v]) {
+            const std::array<int, 3>& face = mesh.F[f];
+            if (face_contains(face, a) && face_contains(face, b)) {
+                continue;
+            }
+            std::array<Eigen::Vector3d, 3> p = {{ mesh.V[face[0]], mesh.V[face[1]], mesh.V[face[2]] }};
+            const Eigen::Vector3d n_old = face_normal(p[0], p[1], p[2]);
+            p[face_index_of(face, v)] = x;
+            const Eigen::Vector3d n_new = face_normal(p[0], p[1], p[2]);
+            const double len_old = n_old.norm(), len_new = n_new.norm();
+            if (len_new <= 1e-12 * len_old || n_old.dot(n_new) < MIN_NORMAL_COSINE * len_old * len_new) {
+                return false;
+            }
+        }
+    }
+
+    // Perform the collapse
+    mesh.V[a] = x;
+    mesh.Q[a] = mesh.Q[a] + mesh.Q[b];
+
+    std::vector<int>& faces_a = mesh.VF[a];
+    faces_a.erase(std::remove_if(faces_a.begin(), faces_a.end(),
+                                 [&](int f) { return face_contains(mesh.F[f], b); }),
+                  faces_a.end());
+    for (int f : mesh.VF[b]) {
+        std::array<int, 3>& face = mesh.F[f];
+        if (face_contains(face, a)) {
+            mesh.face_alive[f] = 0;
+            for (int v : face) {
+                if (v != a && v != b) {
+                    std::vector<int>& faces_v = mesh.VF[v];
+                    faces_v.erase(std::find(faces_v.begin(), faces_v.end(), f));
+                }
+            }
+        } else {
+            face[face_index_of(face, b)] = a;
+            faces_a.push_back(f);
+        }
+    }
+    mesh.VF[b].clear();
+
+    return true;
+}
+
+} // namespace
+
+
+bool decimate_surface(const Eigen::MatrixXd& V,
+                      const Eigen::MatrixXi& F,
+                      double max_error,
+                      Eigen::MatrixXd& V_out,
+                      Eigen::MatrixXi& F_out,
+                      DecimationStats* stats) {
+    const double start_time = igl::get_seconds();
+
+    if (F.rows() == 0 || !is_closed_oriented_manifold(F, V.rows())) {
+        return false;
+    }
+
+    // Build the collapse mesh and the per-vertex quadrics
+    CollapseMesh mesh;
+    mesh.V.resize(V.rows());
+    mesh.F.resize(F.rows());
+    mesh.face_alive.assign(F.rows(), 1);
+    mesh.VF.resize(V.rows());
+    mesh.Q.resize(V.rows());
+    mesh.locked.assign(V.rows(), 0);
+    for (int i = 0; i < V.rows(); i++) {
+        mesh.V[i] = V.row(i).transpose();
+    }
+    for (int i = 0; i < F.rows(); i++) {
+        mesh.F[i] = {{ F(i, 0), F(i, 1), F(i, 2) }};
+        for (int k = 0; k < 3; k++) {
+            mesh.VF[F(i, k)].push_back(i);
+        }
+    }
+    igl::parallel_for(V.rows(), [&](const int v) {
+        for (int f : mesh.VF[v]) {
+            const std::array<int, 3>& face = mesh.F[f];
+            const Eigen::Vector3d n = face_normal(mesh.V[face[0]], mesh.V[face[1]], mesh.V[face[2]]);
+            const double len = n.norm();
+            if (len > 0.0) {
+                mesh.Q[v].add_plane(n / len, -n.dot(mesh.V[face[0]]) / len);
+            }
+        }
+        mesh.locked[v] = !is_manifold_vertex(mesh, v);
+    }, 1000);
+
+    const double max_cost = max_error * max_error;
+    std::vector<Edge> edges;
+    std::vector<int> candidates, selected;
+    std::vector<int> vertex_stamp(V.rows(), 0);
+    int num_rounds = 0;
+
+    for (; num_rounds < MAX_ROUNDS; num_rounds++) {
+        // Each edge appears as u -> v with u < v in exactly one of its faces
+        edges.clear();
+        for (size_t f = 0; f < mesh.F.size(); f++) {
+            if (!mesh.face_alive[f]) {
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                const int u = mesh.F[f][k], v = mesh.F[f][(k + 1) % 3];
+                if (u < v && !mesh.locked[u] && !mesh.locked[v]) {
+                    edges.push_back(Edge{ u, v, 0.0, Eigen::Vector3d::Zero() });
+                }
+            }
+        }
+        igl::parallel_for(edges.size(), [&](const size_t i) { edge_cost(mesh, edges[i]); }, 1000);
+
+        candidates.clear();
+        for (size_t i = 0; i < edges.size(); i++) {
+            if (edges[i].cost <= max_cost) {
+                candidates.push_back(i);
+            }
+        }
+        if (candidates.empty()) {
+            break;
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [&](int i, int j) { return edges[i].cost < edges[j].cost; });
+
+        // Greedily pick cheap edges whose one-rings are disjoint so they can be collapsed concurrently
+        const int stamp = num_rounds + 1;
+        const auto one_ring_available = [&](int v) {
+            for (int f : mesh.VF[v]) {
+                for (int u : mesh.F[f]) {
+                    if (vertex_stamp[u] == stamp) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+        const auto mark_one_ring = [&](int v) {
+            for (int f : mesh.VF[v]) {
+                for (int u : mesh.F[f]) {
+                    vertex_stamp[u] = stamp;
+                }
+            }
+        };
+        selected.clear();
+        for (int i : candidates) {
+            const int a = edges[i].a, b = edges[i].b;
+            if (vertex_stamp[a] != stamp && vertex_stamp[b] != stamp &&
+                    one_ring_available(a) && one_ring_available(b)) {
+                mark_one_ring(a);
+                mark_one_ring(b);
+                selected.push_back(i);
+            }
+        }
+
+        std::vector<char> collapsed(selected.size(), 0);
+        igl::parallel_for(selected.size(), [&](const size_t i) {
+            const Edge& e = edges[selected[i]];
+            collapsed[i] = try_collapse(mesh, e.a, e.b, e.target);
+        }, 64);
+
+        if (std::count(collapsed.begin(), collapsed.end(), 1) == 0) {
+            break;
+        }
+    }
+
+    // Compact the surviving vertices and faces
+    std::vector<int> vertex_map(V.rows(), -1);
+    int num_vertices = 0, num_faces = 0;
+    for (size_t f = 0; f < mesh.F.size(); f++) {
+        if (!mesh.face_alive[f]) {
+            continue;
+        }
+        num_faces += 1;
+        for (int v : mesh.F[f]) {
+            if (vertex_map[v] < 0) {
+                vertex_map[v] = num_vertices++;
+            }
+        }
+    }
+
+    V_out.resize(num_vertices, 3);
+    for (int v = 0; v < V.rows(); v++) {
+        if (vertex_map[v] >= 0) {
+            V_out.row(vertex_map[v]) = mesh.V[v].transpose();
+        }
+    }
+    F_out.resize(num_faces, 3);
+    int count = 0;
+    for (size_t f = 0; f < mesh.F.size(); f++) {
+        if (mesh.face_alive[f]) {
+            const std::array<int, 3>& face = mesh.F[f];
+            F_out.row(count++) = Eigen::RowVector3i(vertex_map[face[0]], vertex_map[face[1]], vertex_map[face[2]]);
+        }
+    }
+
+    if (stats != nullptr) {
+        stats->input_faces = F.rows();
+        stats->output_faces = num_faces;
+        stats->num_rounds = num_rounds;
+        stats->seconds = igl::get_seconds() - start_time;
+    }
+
+    return true;
+}
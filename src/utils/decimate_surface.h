@@ -0,0 +1,32 @@
+#ifndef DECIMATE_SURFACE_H
+#define DECIMATE_SURFACE_H
+
+#include <Eigen/Core>
+
+
+// Summary of a call to decimate_surface
+struct DecimationStats {
+    int input_faces = 0;
+    int output_faces = 0;
+    int num_rounds = 0;
+    double seconds = 0.0;
+};
+
+
+// Simplify a closed, consistently oriented, edge-manifold triangle mesh (V, F) with quadric error edge collapses.
+//
+// Collapses are performed in rounds. Each round computes the cost of every edge in parallel, greedily selects
+// a set of cheap edges whose one-ring neighborhoods do not overlap and collapses them in parallel. Only edges
+// whose quadric error is at most max_error^2 are collapsed, so the output stays within roughly max_error of
+// the input. Every collapse is checked against the link condition and for flipped triangles, thus the output
+// has the same topology as the input and remains watertight.
+//
+// Returns false and leaves V_out, F_out untouched if the input is not a closed manifold mesh.
+bool decimate_surface(const Eigen::MatrixXd& V,
+                      const Eigen::MatrixXi& F,
+                      double max_error,
+                      Eigen::MatrixXd& V_out,
+                      Eigen::MatrixXi& F_out,
+                      DecimationStats* stats = nullptr);
+
+#endif // DECIMATE_SURFACE_H
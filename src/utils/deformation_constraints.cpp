@@ -6,6 +6,7 @@
 #include <Eigen/Geometry>
 
 #include "utils.h"
+#include "tet_mesh_spatial_index.h"
 
 
 bool DeformationConstraints::validate_endpoint_pairs(const std::vector<std::array<int, 2>>& endpoints, const Eigen::VectorXi& components) {
@@ -120,11 +121,12 @@ void DeformationConstraints::clear_orientation_constraints() {
 
 double DeformationConstraints::one_pair_bone_constraints(
     const Eigen::MatrixXd& TV_fat,
-    const Eigen::MatrixXi& TT_fat,
     const Eigen::MatrixXd& TV_thin,
     const Eigen::MatrixXi& TT_thin,
+    const TetMeshSpatialIndex& index,
     const Eigen::VectorXd& geodesic_distances,
     const std::array<int, 2>& endpoints,
+    const std::array<int, 2>& fat_endpoints,
     const Eigen::RowVector3d& straight_dir,
     const Eigen::RowVector3d& straight_origin,
     int num_verts) {
@@ -141,17 +143,11 @@ double DeformationConstraints::one_pair_bone_constraints(
   const int num_endpoint_pairs = endpoints.size();
   assert(num_endpoint_pairs > 0);
 
-  int ctr_idx = nearest_vertex(TV_fat, TV_thin.row(endpoints[0]));
+  int ctr_idx = fat_endpoints[0];
   RowVector3d last_ctr = TV_fat.row(ctr_idx);
   m_bone_constraints_idx.push_back(ctr_idx);
   m_bone_constraints_pos.push_back(straight_origin);
-  int tet_idx = -1;
-  for (int i = 0; i < TT_fat.rows(); i++) {
-    if (TT_fat(i, 0) == ctr_idx || TT_fat(i, 1) == ctr_idx || TT_fat(i, 2) == ctr_idx || TT_fat(i, 3) == ctr_idx) {
-      tet_idx = i;
-      break;
-    }
-  }
+  int tet_idx = index.vertex_tet(ctr_idx);
   assert(tet_idx >= 0);
   m_constrainable_tets_idx.push_back(tet_idx);
 
@@ -160,6 +156,11 @@ double DeformationConstraints::one_pair_bone_constraints(
   double isovalue = geodesic_distances[endpoints[0]];
   const double isovalue_incr = (geodesic_distances[endpoints[1]] - geodesic_distances[endpoints[0]]) / num_verts;
 
+  // Centroids of the level sets along the skeleton and their distance from the first endpoint
+  vector<RowVector3d> centroids;
+  vector<double> centroid_dists;
+  centroids.reserve(num_verts);
+  centroid_dists.reserve(num_verts);
   for(int i = 1; i < num_verts; i++) {
 
     const double last_isovalue = isovalue;
@@ -184,40 +185,17 @@ double DeformationConstraints::one_pair_bone_constraints(
       continue;
     }
 
-//    RowVector3d ctr = LV.colwise().sum() / LV.rows();
-//    dist += (ctr - last_ctr).norm();
-//    last_ctr = ctr;
-
-    RowVector3d ctr = last_ctr;
-    const int tet = containing_tet(TV_fat, TT_fat, ctr);
-    if (tet < 0) {
-      cerr << "WARNING: Vertex not in tet" << endl;
-      continue;
-    }
-
-    Eigen::Matrix<double, 4, 3> v;
-    for (int k = 0; k < 4; k++) { v.row(k) = TV_fat.row(TT_fat(tet, k)); }
-    int nv = TT_fat(tet, nearest_vertex(v, ctr));
-
-    if (vmap.find(nv) == vmap.end()) {
-      vmap.insert(nv);
-      m_bone_constraints_idx.push_back(nv);
-      m_bone_constraints_pos.push_back(straight_origin + dist*straight_dir);
-      m_constrainable_tets_idx.push_back(tet);
-    }
+    centroids.push_back(last_ctr);
+    centroid_dists.push_back(dist);
   }
 
-  ctr_idx = nearest_vertex(TV_fat, TV_thin.row(endpoints[1]));
+  add_centroid_constraints(TV_fat, index, centroids, centroid_dists, straight_dir, straight_origin, vmap);
+
+  ctr_idx = fat_endpoints[1];
   dist += (TV_fat.row(ctr_idx) - last_ctr).norm();
   m_bone_constraints_idx.push_back(ctr_idx);
   m_bone_constraints_pos.push_back(straight_origin + dist*straight_dir);
-  tet_idx = -1;
-  for (int i = 0; i < TT_fat.rows(); i++) {
-    if (TT_fat(i, 0) == ctr_idx || TT_fat(i, 1) == ctr_idx || TT_fat(i, 2) == ctr_idx || TT_fat(i, 3) == ctr_idx) {
-      tet_idx = i;
-      break;
-    }
-  }
+  tet_idx = index.vertex_tet(ctr_idx);
   assert(tet_idx >= 0);
   m_constrainable_tets_idx.push_back(tet_idx);
   return dist;
@@ -242,8 +220,24 @@ double DeformationConstraints::update_bone_constraints(
 
   vector<MatrixXi> TTcomp;
   split_mesh_components(TT_thin, components, TTcomp);
+
+  // The fat mesh is shared by all the pairs, so it is indexed once
+  TetMeshSpatialIndex index;
+  index.build(TV_fat, TT_fat);
+
+  // Snap all the endpoints of the thin mesh to the fat mesh in one batch
+  MatrixXd endpoint_positions(2*num_endpoint_pairs, 3);
   for (int i = 0; i < num_endpoint_pairs; i++) {
-    dist += one_pair_bone_constraints(TV_fat, TT_fat, TV_thin, TTcomp[i], geodesic_distances, endpoints[i],
+    endpoint_positions.row(2*i + 0) = TV_thin.row(endpoints[i][0]);
+    endpoint_positions.row(2*i + 1) = TV_thin.row(endpoints[i][1]);
+  }
+  VectorXi fat_endpoints;
+  index.nearest_vertices(endpoint_positions, fat_endpoints);
+
+  for (int i = 0; i < num_endpoint_pairs; i++) {
+    const array<int, 2> fat_pair = {{ fat_endpoints[2*i + 0], fat_endpoints[2*i + 1] }};
+    dist += one_pair_bone_constraints(TV_fat, TV_thin, TTcomp[i], index, geodesic_distances,
+                                      endpoints[i], fat_pair,
                                       RowVector3d(0, 0, 1),
                                       RowVector3d(0, 0, dist),
                                       num_verts_per_segment);
@@ -255,6 +249,47 @@ double DeformationConstraints::update_bone_constraints(
 }
 
 
+void DeformationConstraints::add_centroid_constraints(
+    const Eigen::MatrixXd& TV,
+    const TetMeshSpatialIndex& index,
+    const std::vector<Eigen::RowVector3d>& centroids,
+    const std::vector<double>& centroid_dists,
+    const Eigen::RowVector3d& straight_dir,
+    const Eigen::RowVector3d& straight_origin,
+    std::unordered_set<int>& vmap) {
+  using namespace std;
+  using namespace Eigen;
+
+  // Locate all the centroids in one batch. Consecutive centroids are close, so each search walks from the
+  // last tet found.
+  MatrixXd P(centroids.size(), 3);
+  for (int i = 0; i < int(centroids.size()); i++) {
+    P.row(i) = centroids[i];
+  }
+  VectorXi tets;
+  index.containing_tets(P, tets);
+
+  for (int i = 0; i < int(centroids.size()); i++) {
+    const int tet = tets[i];
+    if (tet < 0) {
+      cerr << "WARNING: Vertex not in tet" << endl;
+      continue;
+    }
+
+    Eigen::Matrix<double, 4, 3> v;
+    for (int k = 0; k < 4; k++) { v.row(k) = TV.row(index.tets()(tet, k)); }
+    int nv = index.tets()(tet, nearest_vertex(v, centroids[i]));
+
+    if (vmap.find(nv) == vmap.end()) {
+      vmap.insert(nv);
+      m_bone_constraints_idx.push_back(nv);
+      m_bone_constraints_pos.push_back(straight_origin + centroid_dists[i]*straight_dir);
+      m_constrainable_tets_idx.push_back(tet);
+    }
+  }
+}
+
+
 void DeformationConstraints::update_orientation_constraint(
     const Eigen::MatrixXd& TV_fat,
     const Eigen::MatrixXi& TT_fat,
@@ -355,6 +390,7 @@ void DeformationConstraints::scale_bone_constraints(double amount, std::vector<E
 double DeformationConstraints::one_pair_bone_constraints(
     const Eigen::MatrixXd& TV,
     const Eigen::MatrixXi& TT,
+    const TetMeshSpatialIndex& index,
     const Eigen::VectorXd& geodesic_distances,
     const std::array<int, 2>& endpoints,
     const Eigen::RowVector3d& straight_dir,
@@ -376,13 +412,7 @@ double DeformationConstraints::one_pair_bone_constraints(
   RowVector3d last_ctr = TV.row(endpoints[0]);
   m_bone_constraints_idx.push_back(endpoints[0]);
   m_bone_constraints_pos.push_back(straight_origin);
-  int tet_idx = -1;
-  for (int i = 0; i < TT.rows(); i++) {
-    if (TT(i, 0) == endpoints[0] || TT(i, 1) == endpoints[0] || TT(i, 2) == endpoints[0] || TT(i, 3) == endpoints[0]) {
-      tet_idx = i;
-      break;
-    }
-  }
+  int tet_idx = index.vertex_tet(endpoints[0]);
   assert(tet_idx >= 0);
   m_constrainable_tets_idx.push_back(tet_idx);
 
@@ -391,6 +421,10 @@ double DeformationConstraints::one_pair_bone_constraints(
   double isovalue = geodesic_distances[endpoints[0]];
   const double isovalue_incr = (geodesic_distances[endpoints[1]] - geodesic_distances[endpoints[0]]) / num_verts;
 
+  vector<RowVector3d> centroids;
+  vector<double> centroid_dists;
+  centroids.reserve(num_verts);
+  centroid_dists.reserve(num_verts);
   for(int i = 1; i < num_verts; i++) {
     isovalue += isovalue_incr;
     igl::marching_tets(TV, TT, geodesic_distances, isovalue, LV, LF);
@@ -403,35 +437,16 @@ double DeformationConstraints::one_pair_bone_constraints(
     RowVector3d ctr = LV.colwise().sum() / LV.rows();
     dist += (ctr - last_ctr).norm();
     last_ctr = ctr;
-
-    const int tet = containing_tet(TV, TT, ctr);
-    if (tet < 0) {
-      cerr << "WARNING: Vertex not in tet" << endl;
-      continue;
-    }
-
-    Matrix3d v;
-    for (int k = 0; k < 4; k++) { v.row(k) = TV.row(TT(tet, k)); }
-    int nv = TT(tet, nearest_vertex(v, ctr));
-
-    if (vmap.find(nv) == vmap.end()) {
-      vmap.insert(nv);
-      m_bone_constraints_idx.push_back(nv);
-      m_bone_constraints_pos.push_back(straight_origin + dist*straight_dir);
-      m_constrainable_tets_idx.push_back(tet);
-    }
+    centroids.push_back(ctr);
+    centroid_dists.push_back(dist);
   }
 
+  add_centroid_constraints(TV, index, centroids, centroid_dists, straight_dir, straight_origin, vmap);
+
   dist += (TV.row(endpoints[1]) - last_ctr).norm();
   m_bone_constraints_idx.push_back(endpoints[1]);
   m_bone_constraints_pos.push_back(straight_origin + dist*straight_dir);
-  tet_idx = -1;
-  for (int i = 0; i < TT.rows(); i++) {
-    if (TT(i, 0) == endpoints[1] || TT(i, 1) == endpoints[1] || TT(i, 2) == endpoints[1] || TT(i, 3) == endpoints[1]) {
-      tet_idx = i;
-      break;
-    }
-  }
+  tet_idx = index.vertex_tet(endpoints[1]);
   assert(tet_idx >= 0);
   m_constrainable_tets_idx.push_back(tet_idx);
   return dist;
@@ -455,8 +470,14 @@ double DeformationConstraints::update_bone_constraints(
 
   vector<MatrixXi> TTcomp;
   split_mesh_components(TT, components, TTcomp);
+
+  // Each pair only walks its own component, whose tets are disjoint from the others, so one index over the
+  // whole mesh serves all the pairs. Its tet indices are rows of TT rather than of TTcomp[i], which is what
+  // update_orientation_constraint expects in m_constrainable_tets_idx.
+  TetMeshSpatialIndex index;
+  index.build(TV, TT);
   for (int i = 0; i < num_endpoint_pairs; i++) {
-    dist += one_pair_bone_constraints(TV, TTcomp[i], geodesic_distances, endpoints[i],
+    dist += one_pair_bone_constraints(TV, TTcomp[i], index, geodesic_distances, endpoints[i],
                                       RowVector3d(0, 0, 1),
                                       RowVector3d(0, 0, dist),
                                       num_verts_per_segment);
@@ -466,6 +487,3 @@ double DeformationConstraints::update_bone_constraints(
   }
   return dist;
 }
-
-
-
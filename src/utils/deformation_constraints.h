@@ -11,11 +11,14 @@
 #include <unordered_set>
 #include <array>
 
+class TetMeshSpatialIndex;
+
 
 class DeformationConstraints {
   double one_pair_bone_constraints(
       const Eigen::MatrixXd& TV,
       const Eigen::MatrixXi& TT,
+      const TetMeshSpatialIndex& index,
       const Eigen::VectorXd& geodesic_distances,
       const std::array<int, 2>& endpoints,
       const Eigen::RowVector3d& straight_dir,
@@ -24,15 +27,27 @@ class DeformationConstraints {
 
   double one_pair_bone_constraints(
       const Eigen::MatrixXd& TV_fat,
-      const Eigen::MatrixXi& TT_fat,
       const Eigen::MatrixXd& TV_thin,
       const Eigen::MatrixXi& TT_thin,
+      const TetMeshSpatialIndex& index,
       const Eigen::VectorXd& geodesic_distances,
       const std::array<int, 2>& endpoints,
+      const std::array<int, 2>& fat_endpoints,
       const Eigen::RowVector3d& straight_dir,
       const Eigen::RowVector3d& straight_origin,
       int num_verts);
 
+  // Constrain the vertex nearest to each centroid among those of the tet containing it to lie
+  // centroid_dists[i] along the straight line. TV are the vertices the index was built over.
+  void add_centroid_constraints(
+      const Eigen::MatrixXd& TV,
+      const TetMeshSpatialIndex& index,
+      const std::vector<Eigen::RowVector3d>& centroids,
+      const std::vector<double>& centroid_dists,
+      const Eigen::RowVector3d& straight_dir,
+      const Eigen::RowVector3d& straight_origin,
+      std::unordered_set<int>& vmap);
+
     void scale_bone_constraints(double amount, std::vector<Eigen::RowVector3d>& scaled);
 
 public:
@@ -47,7 +62,9 @@ public:
 //  std::vector<double> m_level_set_isovalues;
 //  std::vector<double> m_level_set_distances;
 
-  // Indices of tets which can possibly have rotation constraints
+  // Indices of tets which can possibly have rotation constraints, one per bone constraint. These are rows of
+  // the whole tet mesh passed to update_bone_constraints (TT_fat for the fat+thin overload), never of a single
+  // component, and update_orientation_constraint must be given that same mesh.
   std::vector<int> m_constrainable_tets_idx;
   std::unordered_map<int, std::tuple<int, double, bool>> m_tet_constraints;
 
@@ -83,6 +100,7 @@ public:
                                  const std::vector<std::array<int, 2>>& endpoint_pairs,
                                  int num_verts);
 
+  // Constrain the tet m_constrainable_tets_idx[idx] of TT to rotate by angle about the skeleton
   void update_orientation_constraint(const Eigen::MatrixXd& TV,
                                      const Eigen::MatrixXi& TT,
                                      int idx, double angle, bool flipped_x);
@@ -0,0 +1,505 @@
+#include "distance_operators.h"
+
+#include <Eigen/LU>
+#include <igl/cotmatrix.h>
+#include <igl/grad.h>
+#include <igl/massmatrix.h>
+#include <igl/parallel_for.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+
+namespace {
+
+constexpr int CG_MAX_ITERATIONS = 10000;
+constexpr double CG_TOLERANCE = 1e-8;
+
+// Add weight * e_i e_i^T to A for every pinned vertex i
+DistanceOperators::SparseMatrixXd add_pins(const DistanceOperators::SparseMatrixXd& A,
+                                           const Eigen::VectorXi& pinned_vertices,
+                                           double weight) {
+    std::vector<Eigen::Triplet<double>> triplets;
+    triplets.reserve(pinned_vertices.size());
+    for (int i = 0; i < pinned_vertices.size(); i++) {
+        triplets.emplace_back(pinned_vertices[i], pinned_vertices[i], weight);
+    }
+    DistanceOperators::SparseMatrixXd P(A.rows(), A.cols());
+    P.setFromTriplets(triplets.begin(), triplets.end());
+    return A + P;
+}
+
+// Sum the iterations of consecutive solves and keep the worst residual. Solving stops at the
+// first solve which does not converge, so the last one decides whether all of them converged.
+void accumulate(ConjugateGradientResult& total, const ConjugateGradientResult& result) {
+    total.iterations += result.iterations;
+    total.residual = std::max(total.residual, result.residual);
+    total.converged = result.converged;
+}
+
+} // namespace
+
+
+void DistanceOperators::clear() {
+    _initialized = false;
+    _G.resize(0, 0);
+    _L.resize(0, 0);
+    _M.resize(0, 0);
+    _components.resize(0);
+    _pinned_vertices.resize(0);
+    _tet_volumes.resize(0);
+    _heat_time = 0.0;
+    _laplacian_rows.resize(0, 0);
+    _gradient_rows.resize(0, 0);
+    _heat_rows.resize(0, 0);
+}
+
+
+bool DistanceOperators::precompute(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT, const Eigen::VectorXi& components,
+                                   DistanceSolver solver) {
+    clear();
+    _solver = solver;
+
+    igl::grad(TV, TT, _G);
+    igl::cotmatrix(TV, TT, _L);
+    igl::massmatrix(TV, TT, igl::MASSMATRIX_TYPE_DEFAULT, _M);
+
+    // Pin the first vertex of each component
+    _components = components;
+    const int num_components = components.size() > 0 ? components.maxCoeff() + 1 : 0;
+    _pinned_vertices.setConstant(num_components, -1);
+    for (int i = 0; i < components.size(); i++) {
+        if (_pinned_vertices[components[i]] < 0) {
+            _pinned_vertices[components[i]] = i;
+        }
+    }
+
+    // Tet volumes weigh the divergence in the heat method, whose time step is the squared mean edge length
+    const int num_tets = TT.rows();
+    _tet_volumes.resize(num_tets);
+    std::vector<double> edge_length_sums;
+    double edge_length_sum = 0.0;
+    igl::parallel_for(num_tets,
+        [&](const size_t num_threads) { edge_length_sums.assign(num_threads, 0.0); },
+        [&](const int t, const size_t thread_id) {
+            Eigen::Matrix3d E;
+            for (int j = 0; j < 3; j++) {
+                E.row(j) = TV.row(TT(t, j + 1)) - TV.row(TT(t, 0));
+            }
+            _tet_volumes[t] = std::abs(E.determinant()) / 6.0;
+            edge_length_sums[thread_id] += E.row(0).norm() + E.row(1).norm() + E.row(2).norm() +
+                (E.row(1) - E.row(0)).norm() + (E.row(2) - E.row(0)).norm() + (E.row(2) - E.row(1)).norm();
+        },
+        [&](const size_t thread_id) { edge_length_sum += edge_length_sums[thread_id]; },
+        1000);
+    const double mean_edge_length = num_tets > 0 ? edge_length_sum / (6.0 * num_tets) : 0.0;
+    _heat_time = mean_edge_length * mean_edge_length;
+    const SparseMatrixXd H = _M - _heat_time * _L;
+
+    if (_solver == DistanceSolver::ConjugateGradient) {
+        _laplacian_rows = -_L;
+        _gradient_rows = _G.transpose() * _G;
+        _heat_rows = H;
+        _initialized = true;
+        return true;
+    }
+
+    // Scale the pins like the diagonal of each matrix to keep them well conditioned
+    _pin_weight = std::max(_L.diagonal().cwiseAbs().mean(), 1e-12);
+    _laplacian_solver.compute(add_pins(-_L, _pinned_vertices, _pin_weight));
+    if (_laplacian_solver.info() != Eigen::Success) {
+        return false;
+    }
+
+    const SparseMatrixXd GtG = _G.transpose() * _G;
+    const double gradient_pin_weight = std::max(GtG.diagonal().mean(), 1e-12);
+    _gradient_solver.compute(add_pins(GtG, _pinned_vertices, gradient_pin_weight));
+    if (_gradient_solver.info() != Eigen::Success) {
+        return false;
+    }
+
+    _heat_solver.compute(H);
+    if (_heat_solver.info() != Eigen::Success) {
+        return false;
+    }
+
+    _initialized = true;
+    return true;
+}
+
+
+std::vector<char> DistanceOperators::unconstrained_vertices(const std::vector<std::pair<int, int>>& endpoints) const {
+    std::vector<char> constrained_components(_pinned_vertices.size(), 0);
+    for (const std::pair<int, int>& ep : endpoints) {
+        constrained_components[_components[ep.first]] = 1;
+        constrained_components[_components[ep.second]] = 1;
+    }
+    std::vector<char> unconstrained(_components.size());
+    for (int i = 0; i < _components.size(); i++) {
+        unconstrained[i] = !constrained_components[_components[i]];
+    }
+    return unconstrained;
+}
+
+
+bool DistanceOperators::harmonic(const std::vector<std::pair<int, int>>& endpoints, Eigen::VectorXd& u,
+                                 ConjugateGradientResult* cg_result) const {
+    using namespace Eigen;
+
+    if (!_initialized) {
+        return false;
+    }
+
+    if (_solver == DistanceSolver::ConjugateGradient) {
+        // Fix the endpoints and every vertex of the components without endpoints, and solve for the rest
+        std::vector<char> fixed = unconstrained_vertices(endpoints);
+        if (u.size() != _components.size()) {
+            u.setZero(_components.size());
+        }
+        for (int i = 0; i < u.size(); i++) {
+            if (fixed[i]) {
+                u[i] = 0.0;
+            }
+        }
+        for (const std::pair<int, int>& ep : endpoints) {
+            fixed[ep.first] = fixed[ep.second] = 1;
+            u[ep.first] = 0.0;
+            u[ep.second] = 1.0;
+        }
+        const ConjugateGradientResult result = conjugate_gradient(_laplacian_rows, VectorXd::Zero(u.size()), fixed, u,
+                                                                  CG_MAX_ITERATIONS, CG_TOLERANCE);
+        if (cg_result) {
+            *cg_result = result;
+        }
+        return result.converged;
+    }
+
+    // Dirichlet constraints and the pinned vertices of their components
+    std::vector<int> constrained;
+    std::vector<double> values;
+    std::map<int, int> pins; // component -> column of the pin
+    for (const std::pair<int, int>& ep : endpoints) {
+        constrained.push_back(ep.first);
+        values.push_back(0.0);
+        constrained.push_back(ep.second);
+        values.push_back(1.0);
+    }
+    for (int v : constrained) {
+        pins.emplace(_components[v], 0);
+    }
+    const int k = constrained.size();
+    const int m = pins.size();
+    int pin_col = k;
+    for (auto& pin : pins) {
+        pin.second = pin_col++;
+    }
+
+    // Any harmonic function with the constraints satisfies -L u = C^T mu with mu supported on the constrained
+    // vertices. With the factored matrix A = -L + w P P^T this becomes u = A^-1 (C^T mu + w P rho) where rho
+    // are the values at the pinned vertices, so we solve for the k + m unknowns (mu, rho) with a dense system.
+    MatrixXd R = MatrixXd::Zero(_components.size(), k + m);
+    for (int i = 0; i < k; i++) {
+        R(constrained[i], i) = 1.0;
+    }
+    for (const auto& pin : pins) {
+        R(_pinned_vertices[pin.first], pin.second) = _pin_weight;
+    }
+    const MatrixXd W = _laplacian_solver.solve(R);
+    if (_laplacian_solver.info() != Success) {
+        return false;
+    }
+
+    MatrixXd S(k + m, k + m);
+    VectorXd rhs = VectorXd::Zero(k + m);
+    for (int i = 0; i < k; i++) {
+        S.row(i) = W.row(constrained[i]);
+        rhs[i] = values[i];
+    }
+    for (const auto& pin : pins) {
+        S.row(pin.second) = W.row(_pinned_vertices[pin.first]);
+        S(pin.second, pin.second) -= 1.0;
+    }
+
+    u = W * S.fullPivLu().solve(rhs);
+    return true;
+}
+
+
+bool DistanceOperators::fit_gradient(const Eigen::VectorXd& u, Eigen::VectorXd& phi,
+                                     ConjugateGradientResult* cg_result) const {
+    if (!_initialized) {
+        return false;
+    }
+
+    if (_solver == DistanceSolver::ConjugateGradient) {
+        // Keep the pinned vertices at their value in u and start from u itself
+        std::vector<char> fixed(_components.size(), 0);
+        for (int i = 0; i < _pinned_vertices.size(); i++) {
+            fixed[_pinned_vertices[i]] = 1;
+        }
+        phi = u;
+        const ConjugateGradientResult result = conjugate_gradient(_gradient_rows, _gradient_rows * u, fixed, phi,
+                                                                  CG_MAX_ITERATIONS, CG_TOLERANCE);
+        if (cg_result) {
+            *cg_result = result;
+        }
+        return result.converged;
+    }
+
+    const Eigen::VectorXd g = _G * u;
+    phi = _gradient_solver.solve(_G.transpose() * g);
+    return _gradient_solver.info() == Eigen::Success;
+}
+
+
+bool DistanceOperators::heat_distances(const std::vector<int>& sources, Eigen::MatrixXd& phi,
+                                       DistanceSolveStats* stats) const {
+    using namespace Eigen;
+
+    if (!_initialized) {
+        return false;
+    }
+
+    const int n = num_vertices();
+    const int k = sources.size();
+    const int num_tets = _tet_volumes.size();
+
+    // Heat step: (M - t L) u = delta for every source at once
+    MatrixXd U = MatrixXd::Zero(n, k);
+    for (int j = 0; j < k; j++) {
+        U(sources[j], j) = 1.0;
+    }
+    if (_solver == DistanceSolver::ConjugateGradient) {
+        for (int j = 0; j < k; j++) {
+            const VectorXd delta = U.col(j);
+            VectorXd u = VectorXd::Zero(n);
+            const ConjugateGradientResult result = conjugate_gradient(_heat_rows, delta, std::vector<char>(), u,
+                                                                      CG_MAX_ITERATIONS, CG_TOLERANCE);
+            if (stats) {
+                accumulate(stats->diffusion, result);
+            }
+            if (!result.converged) {
+                return false;
+            }
+            U.col(j) = u;
+        }
+    } else {
+        U = _heat_solver.solve(MatrixXd(U));
+        if (_heat_solver.info() != Success) {
+            return false;
+        }
+    }
+
+    // Normalized negative gradient of u in each tet, weighted by the tet volume. The rows of G are
+    // ordered by coordinate so the gradient of tet t is in rows t, t + #T and t + 2 #T.
+    MatrixXd X = _G * U;
+    igl::parallel_for(num_tets, [&](const int t) {
+        for (int j = 0; j < k; j++) {
+            const Vector3d g(X(t, j), X(num_tets + t, j), X(2 * num_tets + t, j));
+            const double norm = g.norm();
+            const Vector3d x = norm > 0.0 ? Vector3d(-_tet_volumes[t] * g / norm) : Vector3d::Zero();
+            X(t, j) = x[0];
+            X(num_tets + t, j) = x[1];
+            X(2 * num_tets + t, j) = x[2];
+        }
+    }, 1000);
+
+    // Poisson step: -L phi = G^T V X. The right hand side sums to zero on every component, so with
+    // the pinned factorization the pinned vertices come out as zero.
+    const MatrixXd div = _G.transpose() * X;
+    if (_solver == DistanceSolver::ConjugateGradient) {
+        phi.resize(n, k);
+        for (int j = 0; j < k; j++) {
+            std::vector<char> fixed(n, 0);
+            fixed[sources[j]] = 1;
+            VectorXd x = VectorXd::Zero(n);
+            const ConjugateGradientResult result = conjugate_gradient(_laplacian_rows, div.col(j), fixed, x,
+                                                                      CG_MAX_ITERATIONS, CG_TOLERANCE);
+            if (stats) {
+                accumulate(stats->integration, result);
+            }
+            if (!result.converged) {
+                return false;
+            }
+            phi.col(j) = x;
+        }
+    } else {
+        phi = _laplacian_solver.solve(div);
+        if (_laplacian_solver.info() != Success) {
+            return false;
+        }
+    }
+
+    // Distances are zero at the sources
+    for (int j = 0; j < k; j++) {
+        phi.col(j).array() -= phi(sources[j], j);
+    }
+    return true;
+}
+
+
+bool DistanceOperators::distances(const std::vector<std::pair<int, int>>& endpoints, DistanceMethod method,
+                                  Eigen::VectorXd& dists, DistanceSolveStats* stats) const {
+    const int num_components = _pinned_vertices.size();
+
+    if (method == DistanceMethod::Heat) {
+        std::vector<int> sources;
+        std::vector<int> component_column(num_components, -1);
+        for (const std::pair<int, int>& ep : endpoints) {
+            component_column[_components[ep.first]] = sources.size();
+            sources.push_back(ep.first);
+        }
+        Eigen::MatrixXd phi;
+        if (!heat_distances(sources, phi, stats)) {
+            return false;
+        }
+        dists.resize(num_vertices());
+        for (int i = 0; i < dists.size(); i++) {
+            const int column = component_column[_components[i]];
+            dists[i] = column >= 0 ? phi(i, column) : 0.0;
+        }
+    } else {
+        Eigen::VectorXd u = dists;
+        if (!harmonic(endpoints, u, stats ? &stats->diffusion : nullptr) ||
+            !fit_gradient(u, dists, stats ? &stats->integration : nullptr)) {
+            return false;
+        }
+    }
+
+    // Both methods are only defined up to scale and the gradient fit up to a constant on each component
+    Eigen::VectorXd c_min = Eigen::VectorXd::Constant(num_components, std::numeric_limits<double>::max());
+    Eigen::VectorXd c_max = Eigen::VectorXd::Constant(num_components, std::numeric_limits<double>::lowest());
+    for (int i = 0; i < dists.size(); i++) {
+        c_min[_components[i]] = std::min(c_min[_components[i]], dists[i]);
+        c_max[_components[i]] = std::max(c_max[_components[i]], dists[i]);
+    }
+    std::vector<bool> constrained(num_components, false);
+    for (const std::pair<int, int>& ep : endpoints) {
+        constrained[_components[ep.first]] = true;
+    }
+    for (int i = 0; i < dists.size(); i++) {
+        const int c = _components[i];
+        const double spread = c_max[c] - c_min[c];
+        if (!constrained[c]) {
+            dists[i] = -1.0;
+        } else {
+            dists[i] = spread > 0.0 ? (dists[i] - c_min[c]) / spread : 0.0;
+        }
+    }
+    return true;
+}
+
+
+void ComponentDistanceOperators::clear() {
+    _vertex_components.resize(0);
+    _partition = MeshComponents();
+    _operators.clear();
+}
+
+
+int ComponentDistanceOperators::num_initialized() const {
+    int count = 0;
+    for (const std::unique_ptr<DistanceOperators>& operators : _operators) {
+        count += operators ? 1 : 0;
+    }
+    return count;
+}
+
+
+bool ComponentDistanceOperators::precompute(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT,
+                                            const Eigen::VectorXi& components,
+                                            const std::vector<std::pair<int, int>>& endpoints,
+                                            DistanceSolver solver) {
+    if (solver != _solver || _vertex_components.size() != components.size()) {
+        clear();
+        _solver = solver;
+    }
+    if (_operators.empty()) {
+        _vertex_components = components;
+        partition_mesh_components(TT, components, _partition, true /* compute_vertex_maps */);
+        _operators.resize(_partition.num_components());
+    }
+
+    std::vector<int> missing;
+    for (const std::pair<int, int>& ep : endpoints) {
+        const int c = components[ep.first];
+        if (!_operators[c] && std::find(missing.begin(), missing.end(), c) == missing.end()) {
+            missing.push_back(c);
+        }
+    }
+
+    std::vector<char> success(missing.size(), 0);
+    igl::parallel_for(missing.size(), [&](const int i) {
+        const int c = missing[i];
+        Eigen::MatrixXd TVc;
+        Eigen::MatrixXi TTc;
+        _partition.component_mesh(c, TV, TVc, TTc);
+
+        std::unique_ptr<DistanceOperators> operators(new DistanceOperators);
+        success[i] = operators->precompute(TVc, TTc, Eigen::VectorXi::Zero(TVc.rows()), solver);
+        if (success[i]) {
+            _operators[c] = std::move(operators);
+        }
+    }, 2);
+
+    return std::all_of(success.begin(), success.end(), [](char s) { return s != 0; });
+}
+
+
+bool ComponentDistanceOperators::distances(const std::vector<std::pair<int, int>>& endpoints, DistanceMethod method,
+                                           Eigen::VectorXd& dists, DistanceSolveStats* stats) const {
+    // Group the endpoints by component, in local indices
+    std::vector<int> solved_components;
+    std::vector<std::vector<std::pair<int, int>>> local_endpoints;
+    for (const std::pair<int, int>& ep : endpoints) {
+        const int c = _vertex_components[ep.first];
+        if (!_operators[c]) {
+            return false;
+        }
+        const long slot = std::find(solved_components.begin(), solved_components.end(), c) - solved_components.begin();
+        if (slot == long(solved_components.size())) {
+            solved_components.push_back(c);
+            local_endpoints.emplace_back();
+        }
+        local_endpoints[slot].emplace_back(_partition.local_indices[ep.first], _partition.local_indices[ep.second]);
+    }
+
+    const bool warm_start = dists.size() == _vertex_components.size();
+    Eigen::VectorXd result = Eigen::VectorXd::Constant(_vertex_components.size(), -1.0);
+    std::vector<DistanceSolveStats> component_stats(solved_components.size());
+    std::vector<char> success(solved_components.size(), 0);
+    igl::parallel_for(solved_components.size(), [&](const int i) {
+        const int c = solved_components[i];
+        const int* vertices = _partition.vertices.data() + _partition.vertex_offsets[c];
+        const int num_vertices = _partition.num_vertices(c);
+        Eigen::VectorXd component_dists;
+        if (warm_start) {
+            component_dists.resize(num_vertices);
+            for (int v = 0; v < num_vertices; v++) {
+                component_dists[v] = dists[vertices[v]];
+            }
+        }
+        success[i] = _operators[c]->distances(local_endpoints[i], method, component_dists, &component_stats[i]);
+        if (success[i]) {
+            for (int v = 0; v < num_vertices; v++) {
+                result[vertices[v]] = component_dists[v];
+            }
+        }
+    }, 2);
+
+    if (stats) {
+        stats->diffusion.converged = stats->integration.converged = true;
+        for (const DistanceSolveStats& s : component_stats) {
+            stats->diffusion.iterations += s.diffusion.iterations;
+            stats->diffusion.residual = std::max(stats->diffusion.residual, s.diffusion.residual);
+            stats->diffusion.converged = stats->diffusion.converged && s.diffusion.converged;
+            stats->integration.iterations += s.integration.iterations;
+            stats->integration.residual = std::max(stats->integration.residual, s.integration.residual);
+            stats->integration.converged = stats->integration.converged && s.integration.converged;
+        }
+    }
+
+    dists = result;
+    return std::all_of(success.begin(), success.end(), [](char s) { return s != 0; });
+}
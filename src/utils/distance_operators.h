@@ -0,0 +1,166 @@
+#ifndef DISTANCE_OPERATORS_H
+#define DISTANCE_OPERATORS_H
+
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include "conjugate_gradient.h"
+#include "utils.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+// Differential operators of a tet mesh and factorizations of the systems used to compute distance fields on it.
+// These only depend on the mesh, so they are built once and every change of endpoints only costs a few
+// back-substitutions.
+//
+// The cotangent Laplacian and G^T G are singular on each connected component. Instead of eliminating the
+// constrained rows (which would change the matrix every time the endpoints change), one vertex per component
+// is pinned in the factored matrices and the Dirichlet constraints are enforced exactly through a small dense
+// capacitance system.
+//
+// On large meshes the fill-in of the factorizations becomes prohibitive, so the systems can instead be solved
+// with a parallel preconditioned conjugate gradient which only needs memory linear in the size of the mesh.
+// The Dirichlet constraints are then imposed directly on the unknowns and nothing is factored.
+enum class DistanceSolver {
+    Direct = 0,
+    ConjugateGradient = 1,
+};
+
+// Distance field computed by DistanceOperators::distances
+enum class DistanceMethod {
+    // Heat method of Crane et al.: diffuse heat from the first endpoint for a short time, normalize its
+    // gradient and integrate the normalized gradient with a Poisson solve
+    Heat = 0,
+
+    // Harmonic function between the two endpoints followed by a least squares fit to its gradient
+    Harmonic = 1,
+};
+
+// Iteration counts and relative residuals of the iterative solves. These stay zero with the direct solver.
+// With several right hand sides the iterations are summed and the worst residual is kept.
+struct DistanceSolveStats {
+    // Heat step or harmonic solve
+    ConjugateGradientResult diffusion;
+
+    // Poisson step or gradient fit
+    ConjugateGradientResult integration;
+};
+
+class DistanceOperators {
+public:
+    typedef Eigen::SparseMatrix<double> SparseMatrixXd;
+
+    // Assemble the operators for the tet mesh (TV, TT) and prepare them for the given solver. components is the
+    // connected component of each vertex. Returns false if a factorization failed.
+    bool precompute(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT, const Eigen::VectorXi& components,
+                    DistanceSolver solver = DistanceSolver::Direct);
+
+    void clear();
+
+    bool initialized() const { return _initialized; }
+
+    DistanceSolver solver() const { return _solver; }
+
+    // Harmonic function which is 0 at endpoints[i].first and 1 at endpoints[i].second. The function is
+    // zero on components without endpoints. With the iterative solver, u is used as the initial guess if it
+    // has one entry per vertex.
+    bool harmonic(const std::vector<std::pair<int, int>>& endpoints, Eigen::VectorXd& u,
+                  ConjugateGradientResult* cg_result = nullptr) const;
+
+    // Least squares fit of a function to the gradient of u. The fit is zero at the pinned vertex of each component.
+    bool fit_gradient(const Eigen::VectorXd& u, Eigen::VectorXd& phi,
+                      ConjugateGradientResult* cg_result = nullptr) const;
+
+    // Heat method distances from each of the sources. Column j of phi is zero at sources[j] and is only
+    // meaningful on the component of sources[j]. All the sources are solved together as a multi-column right
+    // hand side of the heat and Poisson systems.
+    bool heat_distances(const std::vector<int>& sources, Eigen::MatrixXd& phi,
+                        DistanceSolveStats* stats = nullptr) const;
+
+    // Approximate geodesic distances from endpoints[i].first to endpoints[i].second, scaled to lie between zero
+    // and one on each component with endpoints. Vertices of the other components are set to -1.
+    // With the harmonic method and the iterative solver, dists is used as the initial guess if it has one entry
+    // per vertex, so passing the previous distances makes small changes of the endpoints cheap.
+    bool distances(const std::vector<std::pair<int, int>>& endpoints, DistanceMethod method, Eigen::VectorXd& dists,
+                   DistanceSolveStats* stats = nullptr) const;
+
+    const SparseMatrixXd& G() const { return _G; }
+    const SparseMatrixXd& L() const { return _L; }
+    const SparseMatrixXd& M() const { return _M; }
+
+    int num_vertices() const { return _components.size(); }
+
+private:
+    bool _initialized = false;
+    DistanceSolver _solver = DistanceSolver::Direct;
+
+    // Gradient (3 #T x #V), cotangent Laplacian and mass matrix
+    SparseMatrixXd _G;
+    SparseMatrixXd _L;
+    SparseMatrixXd _M;
+
+    // Component of each vertex and the vertex pinned in each component
+    Eigen::VectorXi _components;
+    Eigen::VectorXi _pinned_vertices;
+
+    // Weight of the pinned vertices in the Laplacian system
+    double _pin_weight = 1.0;
+
+    // Volume of each tet and the time step of the heat method (the squared mean edge length)
+    Eigen::VectorXd _tet_volumes;
+    double _heat_time = 0.0;
+
+    // Factorizations of -L and G^T G with the pinned vertices added to the diagonal, and of M - t L
+    Eigen::SimplicialLDLT<SparseMatrixXd> _laplacian_solver;
+    Eigen::SimplicialLDLT<SparseMatrixXd> _gradient_solver;
+    Eigen::SimplicialLDLT<SparseMatrixXd> _heat_solver;
+
+    // -L, G^T G and M - t L in row major order for the iterative solver, without pins
+    RowMajorSparseMatrixXd _laplacian_rows;
+    RowMajorSparseMatrixXd _gradient_rows;
+    RowMajorSparseMatrixXd _heat_rows;
+
+    // Mark the vertices of the components without any constrained vertex
+    std::vector<char> unconstrained_vertices(const std::vector<std::pair<int, int>>& endpoints) const;
+};
+
+
+// Distance operators for each connected component of a tet mesh. Each endpoint pair lies in its own component,
+// so every component gets its own small systems instead of one global system over the whole mesh. Operators
+// are only built for components with endpoints, the first time they are needed, and the components are
+// prepared and solved in parallel.
+class ComponentDistanceOperators {
+public:
+    // Build the operators of the components containing endpoints which don't have them yet. All the
+    // operators are rebuilt if the solver changes. Returns false if a factorization failed.
+    bool precompute(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT, const Eigen::VectorXi& components,
+                    const std::vector<std::pair<int, int>>& endpoints, DistanceSolver solver);
+
+    void clear();
+
+    DistanceSolver solver() const { return _solver; }
+
+    // Number of components whose operators are built
+    int num_initialized() const;
+
+    // Same as DistanceOperators::distances on the whole mesh. Components without endpoints are skipped and
+    // set to -1. The components must have been prepared with precompute.
+    bool distances(const std::vector<std::pair<int, int>>& endpoints, DistanceMethod method, Eigen::VectorXd& dists,
+                   DistanceSolveStats* stats = nullptr) const;
+
+private:
+    DistanceSolver _solver = DistanceSolver::Direct;
+
+    // Component of each mesh vertex, and the tets and vertices of the mesh grouped by component
+    Eigen::VectorXi _vertex_components;
+    MeshComponents _partition;
+
+    // Operators of each component, null if not built yet
+    std::vector<std::unique_ptr<DistanceOperators>> _operators;
+};
+
+#endif // DISTANCE_OPERATORS_H
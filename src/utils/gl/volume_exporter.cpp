@@ -1,13 +1,17 @@
 #include "volume_exporter.h"
 
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 #include <glm/gtc/type_ptr.hpp>
 #include <igl/opengl/create_shader_program.h>
 
+#include "../slab_writer.h"
+#include "../straighten_volume.h"
+#include "../utils.h"
+
 constexpr const char* SLICE_VERTEX_SHADER = R"(
 #version 150
 // Create two triangles that are filling the entire screen [-1, 1]
@@ -66,25 +70,60 @@ void main() {
 }
 )";
 
-void VolumeExporter::write_texture_data_to_file(std::string filename) {
+// Create a linearly filtered 3D texture which is zero outside its bounds, like the volume textures
+static GLuint create_export_texture() {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    GLfloat transparent_color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, transparent_color);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    return texture;
+}
+
+bool VolumeExporter::write_texture_data_to_file(std::string filename, std::shared_ptr<spdlog::logger> logger) {
     glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, "Export");
-    const size_t num_voxels = size_t(w)*size_t(h)*size_t(d);
-    std::vector<std::uint8_t> out_data;
-    out_data.resize(num_voxels*4);
 
-    glBindTexture(GL_TEXTURE_3D, render_texture);
-    glGetTexImage(GL_TEXTURE_3D, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)out_data.data());
-    glBindTexture(GL_TEXTURE_3D, 0);
-    glFinish();
-
-    std::vector<uint8_t> real_data;
-    real_data.resize(num_voxels);
-    for (size_t i = 0; i < num_voxels; i++) { real_data[i] = out_data[4*i]; }
-    std::ofstream fout;
-    fout.open(filename, std::ios::binary);
-    fout.write(reinterpret_cast<char*>(real_data.data()), num_voxels*sizeof(uint8_t));
-    fout.close();
+    // Read back slabs of slices through the framebuffer, one slice at a time straight into the writer's buffer,
+    // so the host never holds more than two slabs of the volume
+    const size_t slice_size = size_t(w)*size_t(h);
+    const GLsizei slab_depth = GLsizei(std::min<size_t>(std::max<size_t>(SlabWriter::DEFAULT_SLAB_SIZE / slice_size, 1), d));
+    SlabWriter writer(filename, slab_depth*slice_size);
+    if (!writer.is_open()) {
+        logger->error("Failed to open {} for writing", filename);
+        glPopDebugGroup();
+        return false;
+    }
+
+    GLint old_pack_alignment, old_framebuffer;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &old_pack_alignment);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    for (GLsizei first_slice = 0; first_slice < d; first_slice += slab_depth) {
+        const GLsizei num_slices = std::min(slab_depth, d - first_slice);
+        for (GLsizei i = 0; i < num_slices; i++) {
+            glFramebufferTexture3D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_3D, render_texture, 0, first_slice + i);
+            glReadPixels(0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, (void*)(writer.slab() + i*slice_size));
+        }
+        writer.write(num_slices*slice_size);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, old_pack_alignment);
     glPopDebugGroup();
+
+    if (!writer.finish()) {
+        logger->error("Failed to write {}", filename);
+        return false;
+    }
+    logger->info("Wrote {:.1f} MB to {} in {:.2f}s ({:.1f} MB/s)", writer.bytes_written() / (1024.0*1024.0),
+                 filename, writer.elapsed_seconds(), writer.megabytes_per_second());
+    return true;
 }
 
 void VolumeExporter::set_export_dims(GLsizei w, GLsizei h, GLsizei d) {
@@ -117,16 +156,7 @@ void VolumeExporter::init(GLsizei w, GLsizei h, GLsizei d) {
 
     glGenVertexArrays(1, &empty_vao);
 
-    glGenTextures(1, &render_texture);
-    glBindTexture(GL_TEXTURE_3D, render_texture);
-    GLfloat transparent_color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-    glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, transparent_color);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
+    render_texture = create_export_texture();
     set_export_dims(w, h, d);
 
     glGenFramebuffers(1, &framebuffer);
@@ -136,6 +166,27 @@ void VolumeExporter::init(GLsizei w, GLsizei h, GLsizei d) {
 
 }
 
+void VolumeExporter::draw_slice(GLuint target_texture, GLint layer, GLsizei width, GLsizei height,
+                                glm::vec3 ll, glm::vec3 lr, glm::vec3 ur, glm::vec3 ul) {
+    glFramebufferTexture3D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_3D, target_texture, 0, layer);
+    GLenum draw_buffers[1] = {GL_COLOR_ATTACHMENT0};
+    glDrawBuffers(1, draw_buffers);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        exit(EXIT_FAILURE);
+    }
+
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glViewport(0, 0, width, height);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glUniform3fv(slice.ll_location, 1, glm::value_ptr(ll));
+    glUniform3fv(slice.lr_location, 1, glm::value_ptr(lr));
+    glUniform3fv(slice.ul_location, 1, glm::value_ptr(ul));
+    glUniform3fv(slice.ur_location, 1, glm::value_ptr(ur));
+
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
 void VolumeExporter::update(BoundingCage& cage, GLuint volume_texture, glm::ivec3 volume_dims) {
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
@@ -150,56 +201,27 @@ void VolumeExporter::update(BoundingCage& cage, GLuint volume_texture, glm::ivec
     glBindTexture(GL_TEXTURE_3D, volume_texture);
     glUniform1i(slice.texture_location, 0);
 
-    std::vector<double> kf_depths;
-    cage.keyframe_depths(kf_depths);
-    double cage_length = kf_depths.back();
-    int kf_i = 0;
-    for (const BoundingCage::Cell& cell : cage.cells) {
-        double start_depth = kf_depths[kf_i];
-        double end_depth = kf_depths[kf_i + 1];
-
-        int start_frame = int(d * (start_depth / cage_length));
-        int end_frame = int(d * (end_depth / cage_length));
-
-        double start_index = cell.left_keyframe()->index();
-        double end_index = cell.right_keyframe()->index();
-
-        for (int i = start_frame; i < end_frame; i++) {
-            double lam = double(i-start_frame)/double(end_frame-start_frame);
-            double index = (1.0-lam)*start_index + lam*end_index;
-            BoundingCage::KeyFrameIterator kf = cage.keyframe_for_index(index);
-
-            Eigen::MatrixXd v3d = kf->bounding_box_vertices_3d();
-            glm::vec3 ll(v3d(0, 0), v3d(0, 1), v3d(0, 2));
-            glm::vec3 lr(v3d(1, 0), v3d(1, 1), v3d(1, 2));
-            glm::vec3 ur(v3d(2, 0), v3d(2, 1), v3d(2, 2));
-            glm::vec3 ul(v3d(3, 0), v3d(3, 1), v3d(3, 2));
-
-            ll /= glm::vec3(volume_dims);
-            ul /= glm::vec3(volume_dims);
-            lr /= glm::vec3(volume_dims);
-            ur /= glm::vec3(volume_dims);
-
-            glFramebufferTexture3D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_3D, render_texture, 0, i);
-            GLenum draw_buffers[1] = {GL_COLOR_ATTACHMENT0};
-            glDrawBuffers(1, draw_buffers);
-            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-                exit(EXIT_FAILURE);
-            }
+    // Compute the cage index of every output slice, then evaluate all the slice frames in one batch
+    std::vector<int> slices;
+    std::vector<double> slice_indices;
+    straightened_slice_indices(cage, d, slices, slice_indices);
 
-            glClearColor(0.f, 0.f, 0.f, 0.f);
-            glViewport(0, 0, w, h);
-            glClear(GL_COLOR_BUFFER_BIT);
+    BoundingCage::Frames frames;
+    cage.frames_for_indices(Eigen::Map<Eigen::VectorXd>(slice_indices.data(), slice_indices.size()), frames);
 
-            glUniform3fv(slice.ll_location, 1, glm::value_ptr(ll));
-            glUniform3fv(slice.lr_location, 1, glm::value_ptr(lr));
-            glUniform3fv(slice.ul_location, 1, glm::value_ptr(ul));
-            glUniform3fv(slice.ur_location, 1, glm::value_ptr(ur));
+    for (int i = 0; i < int(slices.size()); i++) {
+        const Eigen::Matrix<double, 4, 3>& v3d = frames[i].bounding_box_vertices_3d;
+        glm::vec3 ll(v3d(0, 0), v3d(0, 1), v3d(0, 2));
+        glm::vec3 lr(v3d(1, 0), v3d(1, 1), v3d(1, 2));
+        glm::vec3 ur(v3d(2, 0), v3d(2, 1), v3d(2, 2));
+        glm::vec3 ul(v3d(3, 0), v3d(3, 1), v3d(3, 2));
 
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-        }
+        ll /= glm::vec3(volume_dims);
+        ul /= glm::vec3(volume_dims);
+        lr /= glm::vec3(volume_dims);
+        ur /= glm::vec3(volume_dims);
 
-        kf_i += 1;
+        draw_slice(render_texture, slices[i], w, h, ll, lr, ur, ul);
     }
 
     glBindVertexArray(0);
@@ -209,3 +231,188 @@ void VolumeExporter::update(BoundingCage& cage, GLuint volume_texture, glm::ivec
 
     glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
 }
+
+// Split an export of the given dimensions into bricks of at most brick_budget voxels which each fit in a 3D texture,
+// by repeatedly halving the longest side of the brick
+static glm::ivec3 export_brick_dims(glm::ivec3 dims, GLint max_texture_size, size_t brick_budget) {
+    glm::ivec3 brick = glm::min(dims, glm::ivec3(max_texture_size));
+    while (size_t(brick.x)*size_t(brick.y)*size_t(brick.z) > brick_budget) {
+        const int axis = (brick.x >= brick.y && brick.x >= brick.z) ? 0 : (brick.y >= brick.z ? 1 : 2);
+        if (brick[axis] == 1) {
+            break;
+        }
+        brick[axis] = (brick[axis] + 1) / 2;
+    }
+    return brick;
+}
+
+bool VolumeExporter::write_tiled(const BoundingCage& cage,
+                                 const std::string& volume_rawfile,
+                                 const Eigen::RowVector3i& volume_dims,
+                                 const Eigen::RowVector3i& cage_dims,
+                                 glm::ivec3 output_dims,
+                                 size_t brick_budget,
+                                 std::string filename,
+                                 std::shared_ptr<spdlog::logger> logger) {
+    if (glm::any(glm::lessThanEqual(output_dims, glm::ivec3(0))) || cage.num_keyframes() < 2) {
+        logger->error("Cannot export a {} x {} x {} straightened volume from a cage with {} keyframes",
+                      output_dims.x, output_dims.y, output_dims.z, cage.num_keyframes());
+        return false;
+    }
+
+    // Bricks are no deeper than a slab, so they can be assembled in the slab being written
+    GLint max_texture_size;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_texture_size);
+    const size_t slice_size = size_t(output_dims.x)*size_t(output_dims.y);
+    const int slab_depth = int(std::min<size_t>(std::max<size_t>(SlabWriter::DEFAULT_SLAB_SIZE / slice_size, 1), output_dims.z));
+    const glm::ivec3 brick = export_brick_dims(glm::ivec3(output_dims.x, output_dims.y, slab_depth),
+                                               max_texture_size, brick_budget);
+
+    SlabWriter writer(filename, brick.z*slice_size);
+    if (!writer.is_open()) {
+        logger->error("Failed to open {} for writing", filename);
+        return false;
+    }
+    logger->info("Exporting {} x {} x {} volume in {} x {} x {} bricks",
+                 output_dims.x, output_dims.y, output_dims.z, brick.x, brick.y, brick.z);
+
+    std::vector<int> slices;
+    std::vector<double> slice_indices;
+    straightened_slice_indices(cage, output_dims.z, slices, slice_indices);
+
+    // Sample positions are p * volume_dims / cage_dims - 0.5 in the texel coordinates of the volume
+    const Eigen::RowVector3d scale = volume_dims.cast<double>().cwiseQuotient(cage_dims.cast<double>());
+
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, "Export Tiled");
+    GLint old_viewport[4], old_framebuffer, old_pack_alignment, old_pack_row_length, old_unpack_alignment;
+    glGetIntegerv(GL_VIEWPORT, old_viewport);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &old_pack_alignment);
+    glGetIntegerv(GL_PACK_ROW_LENGTH, &old_pack_row_length);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &old_unpack_alignment);
+
+    // Bricks are read back directly into their place in the slab
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, output_dims.x);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    GLuint brick_texture = create_export_texture();
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RED, brick.x, brick.y, brick.z, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+    GLuint source_texture = create_export_texture();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glUseProgram(slice.program);
+    glBindVertexArray(empty_vao);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(slice.texture_location, 0);
+
+    bool success = true;
+    std::vector<uint8_t> source_data;
+    Eigen::MatrixXd corners;
+    int i = 0;
+    for (int first_slice = 0; first_slice < output_dims.z && success; first_slice += brick.z) {
+        const int num_slices = std::min(brick.z, output_dims.z - first_slice);
+        int n = 0;
+        while (i + n < int(slices.size()) && slices[i + n] < first_slice + num_slices) {
+            n += 1;
+        }
+
+        // Slices which no Cell covers stay black
+        std::fill(writer.slab(), writer.slab() + num_slices*slice_size, uint8_t(0));
+
+        BoundingCage::Frames frames;
+        cage.frames_for_indices(Eigen::Map<const Eigen::VectorXd>(slice_indices.data() + i, n), frames);
+
+        for (int y0 = 0; y0 < output_dims.y && n > 0 && success; y0 += brick.y) {
+            for (int x0 = 0; x0 < output_dims.x && success; x0 += brick.x) {
+                const GLsizei bw = std::min(brick.x, output_dims.x - x0);
+                const GLsizei bh = std::min(brick.y, output_dims.y - y0);
+
+                // Corners (ll, lr, ur, ul) of the brick in each of its slices, and their bounding box, scaled to the
+                // volume
+                corners.resize(4*n, 3);
+                for (int k = 0; k < n; k++) {
+                    const Eigen::Matrix<double, 4, 3>& v3d = frames[k].bounding_box_vertices_3d;
+                    const Eigen::RowVector3d ll = v3d.row(0).cwiseProduct(scale);
+                    const Eigen::RowVector3d dx = (v3d.row(1).cwiseProduct(scale) - ll) / output_dims.x;
+                    const Eigen::RowVector3d dy = (v3d.row(3).cwiseProduct(scale) - ll) / output_dims.y;
+                    corners.row(4*k + 0) = ll + x0*dx + y0*dy;
+                    corners.row(4*k + 1) = corners.row(4*k + 0) + bw*dx;
+                    corners.row(4*k + 2) = corners.row(4*k + 1) + bh*dy;
+                    corners.row(4*k + 3) = corners.row(4*k + 0) + bh*dy;
+                }
+                const Eigen::RowVector3d bbox_min = corners.colwise().minCoeff();
+                const Eigen::RowVector3d bbox_max = corners.colwise().maxCoeff();
+
+                // Only load the texels the brick's samples interpolate between. The region is clipped to the volume,
+                // and the border of the source texture stands in for the zeros outside it.
+                Eigen::RowVector3i region_min, region_max;
+                for (int c = 0; c < 3; c++) {
+                    region_min[c] = std::max(int(std::floor(bbox_min[c] - 0.5)), 0);
+                    region_max[c] = std::min(int(std::floor(bbox_max[c] - 0.5)) + 1, volume_dims[c] - 1);
+                }
+                if ((region_max.array() < region_min.array()).any()) {
+                    continue;
+                }
+                const Eigen::RowVector3i region_dims = region_max - region_min + Eigen::RowVector3i::Ones();
+                if (region_dims.maxCoeff() > max_texture_size) {
+                    logger->error("A {} x {} x {} brick needs a {} x {} x {} region of the volume, which does not fit "
+                                  "in a texture. Try a smaller brick budget.",
+                                  bw, bh, num_slices, region_dims[0], region_dims[1], region_dims[2]);
+                    success = false;
+                    break;
+                }
+                if (!load_rawfile_region(volume_rawfile, volume_dims, region_min, region_dims, source_data, logger)) {
+                    success = false;
+                    break;
+                }
+                glBindTexture(GL_TEXTURE_3D, source_texture);
+                glTexImage3D(GL_TEXTURE_3D, 0, GL_RED, region_dims[0], region_dims[1], region_dims[2], 0,
+                             GL_RED, GL_UNSIGNED_BYTE, source_data.data());
+
+                // Texture coordinates of the corners in the source region
+                const Eigen::RowVector3d region_offset = region_min.cast<double>();
+                const Eigen::RowVector3d region_size = region_dims.cast<double>();
+                for (int k = 0; k < n; k++) {
+                    glm::vec3 uv[4];
+                    for (int c = 0; c < 4; c++) {
+                        const Eigen::RowVector3d p = (corners.row(4*k + c) - region_offset).cwiseQuotient(region_size);
+                        uv[c] = G3f(p);
+                    }
+                    draw_slice(brick_texture, slices[i + k] - first_slice, bw, bh, uv[0], uv[1], uv[2], uv[3]);
+                }
+
+                for (int k = 0; k < n; k++) {
+                    const int layer = slices[i + k] - first_slice;
+                    glFramebufferTexture3D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_3D, brick_texture, 0, layer);
+                    uint8_t* dst = writer.slab() + layer*slice_size + size_t(y0)*output_dims.x + x0;
+                    glReadPixels(0, 0, bw, bh, GL_RED, GL_UNSIGNED_BYTE, (void*)dst);
+                }
+            }
+        }
+
+        writer.write(num_slices*slice_size);
+        i += n;
+    }
+
+    glDeleteTextures(1, &brick_texture);
+    glDeleteTextures(1, &source_texture);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, old_pack_alignment);
+    glPixelStorei(GL_PACK_ROW_LENGTH, old_pack_row_length);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, old_unpack_alignment);
+    glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+    glPopDebugGroup();
+
+    if (!writer.finish() || !success) {
+        logger->error("Failed to write {}", filename);
+        return false;
+    }
+    logger->info("Wrote {:.1f} MB to {} in {:.2f}s ({:.1f} MB/s)", writer.bytes_written() / (1024.0*1024.0),
+                 filename, writer.elapsed_seconds(), writer.megabytes_per_second());
+    return true;
+}
@@ -2,6 +2,10 @@
 
 #include <glm/glm.hpp>
 #include <glad/glad.h>
+#include <spdlog/spdlog.h>
+
+#include <memory>
+#include <string>
 
 #include "../bounding_cage.h"
 #include "glm_conversion.h"
@@ -25,6 +29,11 @@ class VolumeExporter {
 
     GLsizei w = 0, h = 0, d = 0;
 
+    // Render a straightened slice with corners at the texture coordinates ll, lr, ur and ul of the bound volume
+    // texture into the width x height lower left corner of a layer of target_texture
+    void draw_slice(GLuint target_texture, GLint layer, GLsizei width, GLsizei height,
+                    glm::vec3 ll, glm::vec3 lr, glm::vec3 ur, glm::vec3 ul);
+
 public:
 
     glm::ivec3 export_dims() const {
@@ -35,7 +44,9 @@ public:
         return render_texture;
     }
 
-    void write_texture_data_to_file(std::string filename);
+    // Stream the exported volume to a .raw file in slabs of slices. Logs the throughput and returns false if the
+    // file could not be written.
+    bool write_texture_data_to_file(std::string filename, std::shared_ptr<spdlog::logger> logger);
 
     void set_export_dims(GLsizei w, GLsizei h, GLsizei d);
 
@@ -44,4 +55,18 @@ public:
     void destroy();
 
     void update(BoundingCage& cage, GLuint volume_texture, glm::ivec3 volume_dims);
+
+    // Export a straightened volume of any size to a .raw file without allocating a texture for all of it. The output
+    // is rendered in bricks of at most brick_budget voxels, each sampling a texture of only the region of
+    // volume_rawfile it needs, and the bricks are assembled into slabs which are streamed to the file. volume_dims
+    // are the dimensions of volume_rawfile and cage_dims are the dimensions of the volume the cage was fit in.
+    // Logs the throughput and returns false if the export failed.
+    bool write_tiled(const BoundingCage& cage,
+                     const std::string& volume_rawfile,
+                     const Eigen::RowVector3i& volume_dims,
+                     const Eigen::RowVector3i& cage_dims,
+                     glm::ivec3 output_dims,
+                     size_t brick_budget,
+                     std::string filename,
+                     std::shared_ptr<spdlog::logger> logger);
 };
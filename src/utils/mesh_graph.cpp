@@ -0,0 +1,245 @@
+#include "mesh_graph.h"
+
+#include <igl/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+
+namespace {
+
+// Components with at least this many vertices are searched one at a time with the relaxation of each bucket
+// spread over threads. Smaller ones are searched concurrently, one per thread.
+const int PARALLEL_COMPONENT_SIZE = 1 << 16;
+
+// Smallest batch of vertices whose edges are relaxed in parallel
+const int PARALLEL_FRONTIER_SIZE = 4096;
+
+// Circular array of buckets of width delta for a delta-stepping search. The number of buckets is a power of two
+// so wrapping around is a mask.
+struct DeltaBuckets {
+    std::vector<std::vector<int>> buckets;
+    double inv_delta = 1.0;
+
+    // Vertices of the current bucket being relaxed and the improved distances each thread found for their
+    // neighbors, kept to reuse their memory across searches
+    std::vector<int> frontier;
+    std::vector<std::vector<std::pair<int, double>>> requests;
+
+    void reset(double delta, int min_buckets) {
+        inv_delta = 1.0 / delta;
+        int num_buckets = 1;
+        while (num_buckets < min_buckets) {
+            num_buckets *= 2;
+        }
+        buckets.resize(num_buckets);
+        for (std::vector<int>& bucket : buckets) {
+            bucket.clear();
+        }
+    }
+
+    long index(double dist) const { return long(dist * inv_delta); }
+    std::vector<int>& operator[](long i) { return buckets[i & (buckets.size() - 1)]; }
+};
+
+// Shortest path distances from source over a component with the given vertices, returning the vertex farthest from
+// it. Only the entries of dists for those vertices are touched, so components can be searched concurrently.
+//
+// Vertices are kept in buckets of width delta instead of a priority queue and a bucket is relaxed until it is
+// empty, re-inserting any vertex whose distance improves. This computes the same distances as Dijkstra's algorithm,
+// and with delta near the typical edge length most vertices are settled only once.
+//
+// If parallel is true, large batches of a bucket are relaxed in two phases: threads scan the edges of a share of
+// the batch against the current distances and collect the ones that improve, then the improvements are applied
+// in order. Distances are only written in the second phase, so the result is the same as the sequential search.
+int farthest_vertex(const EdgeGraph& graph, int source, const int* vertices, int num_vertices, bool parallel,
+                    Eigen::VectorXd& dists, DeltaBuckets& buckets, double& farthest_dist) {
+    for (int i = 0; i < num_vertices; i++) {
+        dists[vertices[i]] = std::numeric_limits<double>::infinity();
+    }
+
+    auto relax = [&](int w, double d, long& num_pending) {
+        if (d < dists[w]) {
+            dists[w] = d;
+            buckets[buckets.index(d)].push_back(w);
+            num_pending += 1;
+        }
+    };
+
+    std::vector<int>& frontier = buckets.frontier;
+    std::vector<std::vector<std::pair<int, double>>>& requests = buckets.requests;
+
+    dists[source] = 0.0;
+    buckets[0].push_back(source);
+    long num_pending = 1;
+    for (long current = 0; num_pending > 0; current++) {
+        // Vertices re-inserted into the current bucket land in the emptied bucket and form the next batch
+        std::vector<int>& bucket = buckets[current];
+        while (!bucket.empty()) {
+            frontier.clear();
+            frontier.swap(bucket);
+            num_pending -= long(frontier.size());
+
+            // Skip entries left behind when the vertex moved to an earlier bucket
+            auto is_stale = [&](int v) { return buckets.index(dists[v]) != current; };
+
+            if (!parallel || int(frontier.size()) < PARALLEL_FRONTIER_SIZE) {
+                for (const int v : frontier) {
+                    if (is_stale(v)) {
+                        continue;
+                    }
+                    const double dist = dists[v];
+                    for (int i = graph.offsets[v]; i < graph.offsets[v + 1]; i++) {
+                        relax(graph.neighbors[i], dist + graph.weights[i], num_pending);
+                    }
+                }
+                continue;
+            }
+
+            igl::parallel_for(int(frontier.size()), [&](const size_t num_threads) {
+                requests.resize(num_threads);
+                for (std::vector<std::pair<int, double>>& r : requests) {
+                    r.clear();
+                }
+            }, [&](const int k, const size_t t) {
+                const int v = frontier[k];
+                if (is_stale(v)) {
+                    return;
+                }
+                const double dist = dists[v];
+                for (int i = graph.offsets[v]; i < graph.offsets[v + 1]; i++) {
+                    const int w = graph.neighbors[i];
+                    const double d = dist + graph.weights[i];
+                    if (d < dists[w]) {
+                        requests[t].emplace_back(w, d);
+                    }
+                }
+            }, [&](const size_t) {}, PARALLEL_FRONTIER_SIZE);
+
+            for (const std::vector<std::pair<int, double>>& r : requests) {
+                for (const std::pair<int, double>& request : r) {
+                    relax(request.first, request.second, num_pending);
+                }
+            }
+        }
+    }
+
+    int farthest = source;
+    farthest_dist = 0.0;
+    for (int i = 0; i < num_vertices; i++) {
+        const double dist = dists[vertices[i]];
+        if (dist != std::numeric_limits<double>::infinity() && dist > farthest_dist) {
+            farthest_dist = dist;
+            farthest = vertices[i];
+        }
+    }
+    return farthest;
+}
+
+} // namespace
+
+
+void build_edge_graph(const Eigen::MatrixXd& V, const Eigen::MatrixXi& E, EdgeGraph& graph) {
+    const int num_vertices = V.rows();
+    const int num_edges = E.rows();
+
+    // Counting sort of the two half edges of each edge by their source vertex
+    std::vector<std::atomic<int>> cursor(num_vertices);
+    for (int v = 0; v < num_vertices; v++) {
+        cursor[v].store(0, std::memory_order_relaxed);
+    }
+    igl::parallel_for(num_edges, [&](const int i) {
+        cursor[E(i, 0)].fetch_add(1, std::memory_order_relaxed);
+        cursor[E(i, 1)].fetch_add(1, std::memory_order_relaxed);
+    }, 1000);
+
+    graph.offsets.resize(num_vertices + 1);
+    graph.offsets[0] = 0;
+    for (int v = 0; v < num_vertices; v++) {
+        graph.offsets[v + 1] = graph.offsets[v] + cursor[v].load(std::memory_order_relaxed);
+        cursor[v].store(graph.offsets[v], std::memory_order_relaxed);
+    }
+
+    graph.neighbors.resize(2 * num_edges);
+    igl::parallel_for(num_edges, [&](const int i) {
+        graph.neighbors[cursor[E(i, 0)].fetch_add(1, std::memory_order_relaxed)] = E(i, 1);
+        graph.neighbors[cursor[E(i, 1)].fetch_add(1, std::memory_order_relaxed)] = E(i, 0);
+    }, 1000);
+
+    // Threads scatter in any order, so sort the neighbors to make the graph the same on every run
+    graph.weights.resize(2 * num_edges);
+    igl::parallel_for(num_vertices, [&](const int v) {
+        std::sort(graph.neighbors.data() + graph.offsets[v], graph.neighbors.data() + graph.offsets[v + 1]);
+        for (int i = graph.offsets[v]; i < graph.offsets[v + 1]; i++) {
+            graph.weights[i] = (V.row(v) - V.row(graph.neighbors[i])).norm();
+        }
+    }, 1000);
+}
+
+
+void graph_diameter_endpoints(const EdgeGraph& graph,
+                              const Eigen::VectorXi& vertices,
+                              const Eigen::VectorXi& vertex_offsets,
+                              std::vector<std::pair<int, int>>& endpoints,
+                              Eigen::VectorXd& lengths) {
+    const int num_components = vertex_offsets.size() > 0 ? vertex_offsets.size() - 1 : 0;
+    endpoints.assign(num_components, std::make_pair(-1, -1));
+    lengths.setZero(num_components);
+
+    if (graph.weights.size() == 0) {
+        return;
+    }
+
+    // Buckets as wide as the mean edge. An edge spans at most max_weight / delta + 1 buckets past the current
+    // one, so the circular array needs two more than that.
+    const double max_weight = graph.weights.maxCoeff();
+    const double delta = std::max(graph.weights.mean(), max_weight / 1024.0);
+    const int num_buckets = int(std::floor(max_weight / delta)) + 2;
+
+    // Components have disjoint vertices, so they share one distance array
+    Eigen::VectorXd dists(graph.num_vertices());
+
+    auto search_component = [&](int c, bool parallel, DeltaBuckets& component_buckets) {
+        const int* component_vertices = vertices.data() + vertex_offsets[c];
+        const int num_vertices = vertex_offsets[c + 1] - vertex_offsets[c];
+        const int* start = std::find_if(component_vertices, component_vertices + num_vertices,
+                                        [&](int v) { return graph.degree(v) > 0; });
+        if (start == component_vertices + num_vertices) {
+            return;
+        }
+
+        double dist;
+        const int a = farthest_vertex(graph, *start, component_vertices, num_vertices, parallel,
+                                      dists, component_buckets, dist);
+        const int b = farthest_vertex(graph, a, component_vertices, num_vertices, parallel,
+                                      dists, component_buckets, dist);
+        endpoints[c] = std::make_pair(a, b);
+        lengths[c] = dist;
+    };
+
+    // A few large components would leave most threads idle if each got one thread, so they are searched one
+    // after another with parallel relaxation instead
+    std::vector<int> small_components;
+    DeltaBuckets large_buckets;
+    large_buckets.reset(delta, num_buckets);
+    for (int c = 0; c < num_components; c++) {
+        if (vertex_offsets[c + 1] - vertex_offsets[c] >= PARALLEL_COMPONENT_SIZE) {
+            search_component(c, true, large_buckets);
+        } else {
+            small_components.push_back(c);
+        }
+    }
+
+    std::vector<DeltaBuckets> buckets;
+    igl::parallel_for(int(small_components.size()), [&](const size_t num_threads) {
+        buckets.resize(num_threads);
+        for (DeltaBuckets& b : buckets) {
+            b.reset(delta, num_buckets);
+        }
+    }, [&](const int i, const size_t t) {
+        search_component(small_components[i], false, buckets[t]);
+    }, [&](const size_t) {}, 1);
+}
@@ -0,0 +1,43 @@
+#ifndef MESH_GRAPH_H
+#define MESH_GRAPH_H
+
+#include <Eigen/Core>
+
+#include <utility>
+#include <vector>
+
+
+// Undirected graph of the edges of a mesh in compressed sparse row form. The neighbors of vertex v are
+// neighbors[offsets[v]], ..., neighbors[offsets[v + 1] - 1] and weights holds the length of each of those edges.
+struct EdgeGraph {
+    Eigen::VectorXi offsets;
+    Eigen::VectorXi neighbors;
+    Eigen::VectorXd weights;
+
+    int num_vertices() const { return offsets.size() > 0 ? offsets.size() - 1 : 0; }
+    int degree(int v) const { return offsets[v + 1] - offsets[v]; }
+
+    void clear() {
+        offsets.resize(0);
+        neighbors.resize(0);
+        weights.resize(0);
+    }
+};
+
+// Build the graph of the unique edges E (see tet_mesh_edges) over the vertices V, weighted by edge length
+void build_edge_graph(const Eigen::MatrixXd& V, const Eigen::MatrixXi& E, EdgeGraph& graph);
+
+// Approximate the two vertices farthest apart in each connected component of graph with a double sweep: a
+// Dijkstra search from any vertex of the component finds the farthest vertex a, and a second search from a finds
+// the vertex b farthest from it. The vertices of component c are vertices[vertex_offsets[c]], ...,
+// vertices[vertex_offsets[c + 1] - 1] as in MeshComponents. Small components are processed in parallel, and
+// large ones one at a time with each search step spread over threads.
+//
+// endpoints[c] is (a, b), or (-1, -1) if component c has no edges, and lengths[c] is the graph distance between them.
+void graph_diameter_endpoints(const EdgeGraph& graph,
+                              const Eigen::VectorXi& vertices,
+                              const Eigen::VectorXi& vertex_offsets,
+                              std::vector<std::pair<int, int>>& endpoints,
+                              Eigen::VectorXd& lengths);
+
+#endif // MESH_GRAPH_H
@@ -0,0 +1,35 @@
+#include "project_file.h"
+
+
+void ImageInput::serialize(std::vector<char>& buffer) const {
+    igl::serialize(input_dir, std::string("image_input.input_dir"), buffer);
+    igl::serialize(output_dir, std::string("image_input.output_dir"), buffer);
+    igl::serialize(file_extension, std::string("image_input.file_extension"), buffer);
+    igl::serialize(prefix, std::string("image_input.prefix"), buffer);
+    igl::serialize(downsample_factor, std::string("image_input.downsample_factor"), buffer);
+    igl::serialize(start_index, std::string("image_input.start_index"), buffer);
+    igl::serialize(end_index, std::string("image_input.end_index"), buffer);
+    igl::serialize(project_name, std::string("image_input.project_name"), buffer);
+}
+
+void ImageInput::deserialize(const std::vector<char>& buffer) {
+    igl::deserialize(input_dir, std::string("image_input.input_dir"), buffer);
+    igl::deserialize(output_dir, std::string("image_input.output_dir"), buffer);
+    igl::deserialize(file_extension, std::string("image_input.file_extension"), buffer);
+    igl::deserialize(prefix, std::string("image_input.prefix"), buffer);
+    igl::deserialize(downsample_factor, std::string("image_input.downsample_factor"), buffer);
+    igl::deserialize(start_index, std::string("image_input.start_index"), buffer);
+    igl::deserialize(end_index, std::string("image_input.end_index"), buffer);
+    igl::deserialize(project_name, std::string("image_input.project_name"), buffer);
+}
+
+
+void ProjectCage::serialize(std::vector<char>& buffer) const {
+    input_metadata.serialize(buffer);
+    igl::serialize(cage, std::string("cage"), buffer);
+}
+
+void ProjectCage::deserialize(const std::vector<char>& buffer) {
+    input_metadata.deserialize(buffer);
+    igl::deserialize(cage, std::string("cage"), buffer);
+}
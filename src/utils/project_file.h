@@ -0,0 +1,76 @@
+#ifndef PROJECT_FILE_H
+#define PROJECT_FILE_H
+
+#include <igl/serialize.h>
+
+#include <string>
+#include <vector>
+
+#include "bounding_cage.h"
+
+
+// Location and naming of the input volume of a project
+struct ImageInput {
+    std::string input_dir;
+    std::string output_dir;
+    std::string file_extension;
+    std::string prefix;
+    std::string project_name;
+
+    int downsample_factor = 8;
+    int start_index;
+    int end_index;
+
+    std::string full_res_prefix() {
+        std::string str = prefix + std::string("-") + std::to_string(start_index) + std::string("-") + std::to_string(end_index);
+        return str;
+    }
+
+    std::string low_res_prefix() {
+        std::string str = prefix + std::string("-") + std::to_string(start_index) + std::string("-") + std::to_string(end_index) + std::string("-") + std::to_string(downsample_factor);
+        return str;
+    }
+
+    std::string low_res_path_prefx() {
+        return output_dir + "/" + low_res_prefix();
+    }
+
+    std::string full_res_path_prefix() {
+        return output_dir + "/" + full_res_prefix();
+    }
+
+    // Read and write the "image_input.*" entries of a project file
+    void serialize(std::vector<char>& buffer) const;
+    void deserialize(const std::vector<char>& buffer);
+};
+
+
+// The input volume and bounding cage of a project, which is all that is needed to export its straightened volume.
+// This reads the same "state" object of a project file as the UI, skipping the meshes and the rest of the UI state,
+// so it does not need a GL context. Set the logger of the cage before loading:
+//
+//   ProjectCage project;
+//   project.cage.set_logger(logger);
+//   bool ok = igl::deserialize(project, "state", filename);
+struct ProjectCage {
+    ImageInput input_metadata;
+    BoundingCage cage;
+
+    void serialize(std::vector<char>& buffer) const;
+    void deserialize(const std::vector<char>& buffer);
+};
+
+namespace igl {
+namespace serialization {
+
+template <> inline void serialize(const ProjectCage& obj, std::vector<char>& buffer) {
+    obj.serialize(buffer);
+}
+template <> inline void deserialize(ProjectCage& obj, const std::vector<char>& buffer){
+    obj.deserialize(buffer);
+}
+
+}
+}
+
+#endif // PROJECT_FILE_H
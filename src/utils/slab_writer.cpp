@@ -0,0 +1,51 @@
+#include "slab_writer.h"
+
+#include <cassert>
+
+#include <igl/get_seconds.h>
+
+
+SlabWriter::SlabWriter(const std::string& filename, std::size_t slab_size) {
+    _file.open(filename, std::ios::binary);
+    _write_failed = !_file.is_open();
+    _buffers[0].resize(slab_size);
+    _buffers[1].resize(slab_size);
+    _start_time = igl::get_seconds();
+}
+
+SlabWriter::~SlabWriter() {
+    finish();
+}
+
+void SlabWriter::wait_for_write() {
+    if (_write_thread.joinable()) {
+        _write_thread.join();
+    }
+}
+
+void SlabWriter::write(std::size_t num_bytes) {
+    assert("Slab is larger than the buffer" && num_bytes <= slab_size());
+
+    // The other buffer becomes the next slab, so its write has to be done
+    wait_for_write();
+
+    const std::uint8_t* data = _buffers[_current].data();
+    _write_thread = std::thread([this, data, num_bytes]() {
+        _file.write(reinterpret_cast<const char*>(data), num_bytes);
+        if (!_file) {
+            _write_failed = true;
+        }
+    });
+    _bytes_written += num_bytes;
+    _current = 1 - _current;
+}
+
+bool SlabWriter::finish() {
+    wait_for_write();
+    if (_file.is_open()) {
+        _file.close();
+        _write_failed = _write_failed || _file.fail();
+        _elapsed_time = igl::get_seconds() - _start_time;
+    }
+    return !_write_failed;
+}
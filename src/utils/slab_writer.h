@@ -0,0 +1,70 @@
+#ifndef SLAB_WRITER_H
+#define SLAB_WRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Write a file in slabs of at most slab_size bytes through two buffers. While a background thread writes one
+// slab to disk, the caller fills the next one, so producing the data and writing it overlap and memory use is
+// two slabs however large the file gets.
+//
+// Usage:
+//   SlabWriter writer(filename, slab_size);
+//   while (...) {
+//       fill(writer.slab(), n);
+//       writer.write(n);
+//   }
+//   bool ok = writer.finish();
+class SlabWriter {
+    std::ofstream _file;
+    std::vector<std::uint8_t> _buffers[2];
+    int _current = 0;
+
+    // Thread writing the other buffer, if any
+    std::thread _write_thread;
+    bool _write_failed = false;
+
+    std::size_t _bytes_written = 0;
+    double _start_time = 0.0;
+    double _elapsed_time = 0.0;
+
+    void wait_for_write();
+
+public:
+    // Default slab size. Two slabs of this size are in memory while writing.
+    static constexpr std::size_t DEFAULT_SLAB_SIZE = std::size_t(32) << 20;
+
+    SlabWriter(const std::string& filename, std::size_t slab_size = DEFAULT_SLAB_SIZE);
+    ~SlabWriter();
+
+    SlabWriter(const SlabWriter&) = delete;
+    SlabWriter& operator=(const SlabWriter&) = delete;
+
+    bool is_open() const { return _file.is_open(); }
+
+    std::size_t slab_size() const { return _buffers[0].size(); }
+
+    // The buffer to fill with the next slab. This is not being written, so it is safe to modify until write().
+    std::uint8_t* slab() { return _buffers[_current].data(); }
+
+    // Queue the first num_bytes of slab() to be written after the previous slab and swap buffers
+    void write(std::size_t num_bytes);
+
+    // Wait for the queued slabs to be written and close the file. Returns false if any write failed.
+    bool finish();
+
+    std::size_t bytes_written() const { return _bytes_written; }
+
+    // Time from the construction of the writer until finish(), including producing the data
+    double elapsed_seconds() const { return _elapsed_time; }
+
+    double megabytes_per_second() const {
+        return _elapsed_time > 0.0 ? double(_bytes_written) / (1024.0*1024.0) / _elapsed_time : 0.0;
+    }
+};
+
+#endif // SLAB_WRITER_H
@@ -0,0 +1,246 @@
+#include "straighten_volume.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include <igl/parallel_for.h>
+
+#include "slab_writer.h"
+
+
+void straightened_slice_indices(const BoundingCage& cage, int d, std::vector<int>& slices, std::vector<double>& indices) {
+    slices.clear();
+    indices.clear();
+    if (cage.num_keyframes() < 2) {
+        return;
+    }
+
+    const std::vector<double>& kf_depths = cage.keyframe_depths();
+    const double cage_length = cage.cage_length();
+    int kf_i = 0;
+    for (const BoundingCage::Cell& cell : cage.cells) {
+        double start_depth = kf_depths[kf_i];
+        double end_depth = kf_depths[kf_i + 1];
+
+        int start_frame = int(d * (start_depth / cage_length));
+        int end_frame = int(d * (end_depth / cage_length));
+
+        double start_index = cell.left_keyframe()->index();
+        double end_index = cell.right_keyframe()->index();
+
+        // Space the slices evenly along the smoothed skeleton, so they are not bunched up where its vertices are
+        double start_length = cage.skeleton_arc_length(start_index);
+        double end_length = cage.skeleton_arc_length(end_index);
+        const bool by_length = end_length > start_length;
+
+        for (int i = start_frame; i < end_frame; i++) {
+            double lam = double(i-start_frame)/double(end_frame-start_frame);
+            slices.push_back(i);
+            if (by_length) {
+                double index = cage.skeleton_index_for_arc_length((1.0-lam)*start_length + lam*end_length);
+                indices.push_back(std::max(start_index, std::min(index, end_index)));
+            } else {
+                indices.push_back((1.0-lam)*start_index + lam*end_index);
+            }
+        }
+
+        kf_i += 1;
+    }
+}
+
+
+// Trilinearly sample one row of w output pixels whose texel space positions are start + x*step.
+// Texel (i, j, k) is centered at (i, j, k) and texels outside the volume are zero, like a GL texture
+// with GL_LINEAR filtering and a transparent GL_CLAMP_TO_BORDER border.
+static void straighten_row(const std::uint8_t* volume, const Eigen::RowVector3i& dims,
+                           const Eigen::RowVector3d& start, const Eigen::RowVector3d& step,
+                           int w, std::uint8_t* out) {
+    const int BLOCK_SIZE = 64;
+    const std::ptrdiff_t stride_y = dims[0], stride_z = std::ptrdiff_t(dims[0])*dims[1];
+
+    auto texel = [&](int x, int y, int z) -> float {
+        const bool inside = x >= 0 && y >= 0 && z >= 0 && x < dims[0] && y < dims[1] && z < dims[2];
+        return inside ? float(volume[x + y*stride_y + z*stride_z]) : 0.0f;
+    };
+
+    int ix[BLOCK_SIZE], iy[BLOCK_SIZE], iz[BLOCK_SIZE];
+    float fx[BLOCK_SIZE], fy[BLOCK_SIZE], fz[BLOCK_SIZE];
+    for (int x0 = 0; x0 < w; x0 += BLOCK_SIZE) {
+        const int n = std::min(BLOCK_SIZE, w - x0);
+
+        // Split the positions of the block into texel and fraction in a separate loop, so it vectorizes
+        for (int k = 0; k < n; k++) {
+            const double px = start[0] + (x0 + k)*step[0];
+            const double py = start[1] + (x0 + k)*step[1];
+            const double pz = start[2] + (x0 + k)*step[2];
+            const double flx = std::floor(px), fly = std::floor(py), flz = std::floor(pz);
+            ix[k] = int(flx);
+            iy[k] = int(fly);
+            iz[k] = int(flz);
+            fx[k] = float(px - flx);
+            fy[k] = float(py - fly);
+            fz[k] = float(pz - flz);
+        }
+
+        for (int k = 0; k < n; k++) {
+            const int x = ix[k], y = iy[k], z = iz[k];
+            if (x < -1 || y < -1 || z < -1 || x >= dims[0] || y >= dims[1] || z >= dims[2]) {
+                out[x0 + k] = 0;
+                continue;
+            }
+
+            float c000, c100, c010, c110, c001, c101, c011, c111;
+            if (x >= 0 && y >= 0 && z >= 0 && x+1 < dims[0] && y+1 < dims[1] && z+1 < dims[2]) {
+                const std::uint8_t* p = volume + x + y*stride_y + z*stride_z;
+                c000 = p[0];
+                c100 = p[1];
+                c010 = p[stride_y];
+                c110 = p[stride_y + 1];
+                c001 = p[stride_z];
+                c101 = p[stride_z + 1];
+                c011 = p[stride_z + stride_y];
+                c111 = p[stride_z + stride_y + 1];
+            } else {
+                c000 = texel(x, y, z);
+                c100 = texel(x+1, y, z);
+                c010 = texel(x, y+1, z);
+                c110 = texel(x+1, y+1, z);
+                c001 = texel(x, y, z+1);
+                c101 = texel(x+1, y, z+1);
+                c011 = texel(x, y+1, z+1);
+                c111 = texel(x+1, y+1, z+1);
+            }
+
+            const float c00 = c000 + fx[k]*(c100 - c000);
+            const float c10 = c010 + fx[k]*(c110 - c010);
+            const float c01 = c001 + fx[k]*(c101 - c001);
+            const float c11 = c011 + fx[k]*(c111 - c011);
+            const float c0 = c00 + fy[k]*(c10 - c00);
+            const float c1 = c01 + fy[k]*(c11 - c01);
+            const float c = c0 + fz[k]*(c1 - c0);
+
+            // Round to the nearest byte like the conversion of a normalized color to GL_UNSIGNED_BYTE
+            out[x0 + k] = std::uint8_t(std::min(c + 0.5f, 255.0f));
+        }
+    }
+}
+
+
+// Resample n slices of the output into out, which holds the slices starting at first_slice. slices[i] is the output
+// slice sampled at cage index indices[i].
+static void straighten_slices(const BoundingCage& cage,
+                              const std::vector<std::uint8_t>& volume,
+                              const Eigen::RowVector3i& volume_dims,
+                              const Eigen::RowVector3i& cage_dims,
+                              int w, int h,
+                              const int* slices, const double* indices, int n,
+                              int first_slice, std::uint8_t* out) {
+    BoundingCage::Frames frames;
+    cage.frames_for_indices(Eigen::Map<const Eigen::VectorXd>(indices, n), frames);
+
+    // The exporter samples the normalized coordinates p / cage_dims, which are p * volume_dims / cage_dims - 0.5
+    // in the texel coordinates of volume
+    const Eigen::RowVector3d scale = volume_dims.cast<double>().cwiseQuotient(cage_dims.cast<double>());
+
+    const int ROWS_PER_TILE = 16;
+    const int tiles_per_slice = (h + ROWS_PER_TILE - 1) / ROWS_PER_TILE;
+    igl::parallel_for(n*tiles_per_slice, [&](const int task) {
+        const int i = task / tiles_per_slice;
+        const int first_row = (task % tiles_per_slice) * ROWS_PER_TILE;
+        const int last_row = std::min(first_row + ROWS_PER_TILE, h);
+
+        // The slice is the parallelogram spanned by its lower left, lower right and upper left corners. Pixel (x, y)
+        // is sampled at its center, origin + x*dx + y*dy.
+        const Eigen::Matrix<double, 4, 3>& V = frames[i].bounding_box_vertices_3d;
+        const Eigen::RowVector3d ll = V.row(0).cwiseProduct(scale);
+        const Eigen::RowVector3d lr = V.row(1).cwiseProduct(scale);
+        const Eigen::RowVector3d ul = V.row(3).cwiseProduct(scale);
+        const Eigen::RowVector3d dx = (lr - ll) / w;
+        const Eigen::RowVector3d dy = (ul - ll) / h;
+        const Eigen::RowVector3d origin = ll + 0.5*dx + 0.5*dy - Eigen::RowVector3d::Constant(0.5);
+
+        std::uint8_t* slice_out = out + std::size_t(slices[i] - first_slice)*w*h;
+        for (int y = first_row; y < last_row; y++) {
+            straighten_row(volume.data(), volume_dims, origin + y*dy, dx, w, slice_out + std::size_t(y)*w);
+        }
+    }, 1);
+}
+
+
+void straighten_volume(const BoundingCage& cage,
+                       const std::vector<std::uint8_t>& volume,
+                       const Eigen::RowVector3i& volume_dims,
+                       const Eigen::RowVector3i& cage_dims,
+                       int w, int h, int d,
+                       std::vector<std::uint8_t>& out) {
+    out.assign(std::size_t(std::max(w, 0))*std::max(h, 0)*std::max(d, 0), 0);
+    if (w <= 0 || h <= 0 || d <= 0 || cage.num_keyframes() < 2) {
+        return;
+    }
+    assert("Volume size does not match its dimensions" &&
+           volume.size() == std::size_t(volume_dims[0])*volume_dims[1]*volume_dims[2]);
+
+    std::vector<int> slices;
+    std::vector<double> slice_indices;
+    straightened_slice_indices(cage, d, slices, slice_indices);
+
+    straighten_slices(cage, volume, volume_dims, cage_dims, w, h,
+                      slices.data(), slice_indices.data(), int(slices.size()), 0, out.data());
+}
+
+
+bool write_straightened_volume(const BoundingCage& cage,
+                               const std::vector<std::uint8_t>& volume,
+                               const Eigen::RowVector3i& volume_dims,
+                               const Eigen::RowVector3i& cage_dims,
+                               int w, int h, int d,
+                               const std::string& filename,
+                               std::shared_ptr<spdlog::logger> logger) {
+    if (w <= 0 || h <= 0 || d <= 0 || cage.num_keyframes() < 2) {
+        logger->error("Cannot export a {} x {} x {} straightened volume from a cage with {} keyframes",
+                      w, h, d, cage.num_keyframes());
+        return false;
+    }
+    assert("Volume size does not match its dimensions" &&
+           volume.size() == std::size_t(volume_dims[0])*volume_dims[1]*volume_dims[2]);
+
+    std::vector<int> slices;
+    std::vector<double> slice_indices;
+    straightened_slice_indices(cage, d, slices, slice_indices);
+
+    const std::size_t slice_size = std::size_t(w)*h;
+    const int slab_depth = int(std::min<std::size_t>(std::max<std::size_t>(SlabWriter::DEFAULT_SLAB_SIZE / slice_size, 1), d));
+    SlabWriter writer(filename, slab_depth*slice_size);
+    if (!writer.is_open()) {
+        logger->error("Failed to open {} for writing", filename);
+        return false;
+    }
+
+    // Slices are sorted, so each slab resamples the next run of them
+    int i = 0;
+    for (int first_slice = 0; first_slice < d; first_slice += slab_depth) {
+        const int num_slices = std::min(slab_depth, d - first_slice);
+        int n = 0;
+        while (i + n < int(slices.size()) && slices[i + n] < first_slice + num_slices) {
+            n += 1;
+        }
+
+        // Slices which no Cell covers stay black
+        std::fill(writer.slab(), writer.slab() + num_slices*slice_size, std::uint8_t(0));
+        if (n > 0) {
+            straighten_slices(cage, volume, volume_dims, cage_dims, w, h,
+                              slices.data() + i, slice_indices.data() + i, n, first_slice, writer.slab());
+        }
+        writer.write(num_slices*slice_size);
+        i += n;
+    }
+
+    if (!writer.finish()) {
+        logger->error("Failed to write {}", filename);
+        return false;
+    }
+    logger->info("Wrote {:.1f} MB to {} in {:.2f}s ({:.1f} MB/s)", writer.bytes_written() / (1024.0*1024.0),
+                 filename, writer.elapsed_seconds(), writer.megabytes_per_second());
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef STRAIGHTEN_VOLUME_H
+#define STRAIGHTEN_VOLUME_H
+
+#include <Eigen/Core>
+#include <spdlog/spdlog.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bounding_cage.h"
+
+
+// Compute which of the d output slices of a straightened volume lie in each Cell of the cage and the cage index
+// each of them is sampled at. Slices are spread over the Cells in proportion to their length along the keyframe
+// centroids, and evenly along the smoothed skeleton within each Cell. slices[i] is an output slice and indices[i]
+// is its index in the cage.
+void straightened_slice_indices(const BoundingCage& cage, int d, std::vector<int>& slices, std::vector<double>& indices);
+
+
+// Resample a UINT8 volume along the cage into a w x h x d straightened volume on the CPU, without a GL context.
+//
+// volume has dimensions volume_dims with x varying fastest, and cage_dims are the dimensions of the volume the cage
+// was fit in, which may be a lower resolution copy of volume. Slice z of the output is the bounding box of the cage
+// frame at the z-th slice index, sampled at pixel centers with trilinear interpolation and zero outside the volume.
+// This matches VolumeExporter, so out has the same layout as the .raw files it writes (x fastest, then y, then z)
+// and the same values up to the rounding of the GPU's filtering weights.
+//
+// Slices and tiles of rows are resampled in parallel.
+void straighten_volume(const BoundingCage& cage,
+                       const std::vector<std::uint8_t>& volume,
+                       const Eigen::RowVector3i& volume_dims,
+                       const Eigen::RowVector3i& cage_dims,
+                       int w, int h, int d,
+                       std::vector<std::uint8_t>& out);
+
+
+// Resample the straightened volume like straighten_volume and stream it to a .raw file in slabs of slices. The next
+// slab is resampled while the previous one is written, and only two slabs are ever in memory, however deep the
+// output is. Logs the throughput and returns false if the file could not be written.
+bool write_straightened_volume(const BoundingCage& cage,
+                               const std::vector<std::uint8_t>& volume,
+                               const Eigen::RowVector3i& volume_dims,
+                               const Eigen::RowVector3i& cage_dims,
+                               int w, int h, int d,
+                               const std::string& filename,
+                               std::shared_ptr<spdlog::logger> logger);
+
+#endif // STRAIGHTEN_VOLUME_H
@@ -0,0 +1,65 @@
+#include "surface_picking.h"
+
+#include <igl/Hit.h>
+#include <igl/get_seconds.h>
+#include <igl/unproject_onto_mesh.h>
+
+#include <random>
+
+
+bool pick_surface(const SurfaceTree& tree,
+                  const Eigen::MatrixXd& V,
+                  const Eigen::MatrixXi& F,
+                  const Eigen::Vector2f& pos,
+                  const Eigen::Matrix4f& model,
+                  const Eigen::Matrix4f& proj,
+                  const Eigen::Vector4f& viewport,
+                  int& fid,
+                  Eigen::Vector3f& bc) {
+    const auto shoot_ray = [&](const Eigen::Vector3f& s, const Eigen::Vector3f& dir, igl::Hit& hit) {
+        return tree.intersect_ray(V, F, s.cast<double>().transpose(), dir.cast<double>().transpose(), hit);
+    };
+    return igl::unproject_onto_mesh(pos, model, proj, viewport, shoot_ray, fid, bc);
+}
+
+
+RayBenchmarkStats benchmark_surface_rays(const SurfaceTree& tree,
+                                         const Eigen::MatrixXd& V,
+                                         const Eigen::MatrixXi& F,
+                                         int num_rays,
+                                         unsigned seed) {
+    RayBenchmarkStats stats;
+    if (F.rows() == 0 || num_rays <= 0) {
+        return stats;
+    }
+
+    const Eigen::RowVector3d bbox_min = V.colwise().minCoeff();
+    const Eigen::RowVector3d bbox_max = V.colwise().maxCoeff();
+    const Eigen::RowVector3d center = 0.5 * (bbox_min + bbox_max);
+    const double radius = (bbox_max - bbox_min).norm();
+
+    // Generate all the rays up front so only the queries are timed
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> normal;
+    std::uniform_int_distribution<int> random_face(0, F.rows() - 1);
+    Eigen::MatrixXd origins(num_rays, 3), dirs(num_rays, 3);
+    for (int i = 0; i < num_rays; i++) {
+        const Eigen::RowVector3d n = Eigen::RowVector3d(normal(rng), normal(rng), normal(rng)).normalized();
+        const int f = random_face(rng);
+        const Eigen::RowVector3d target = (V.row(F(f, 0)) + V.row(F(f, 1)) + V.row(F(f, 2))) / 3.0;
+        origins.row(i) = center + radius * n;
+        dirs.row(i) = target - origins.row(i);
+    }
+
+    igl::Hit hit;
+    const double start_time = igl::get_seconds();
+    for (int i = 0; i < num_rays; i++) {
+        if (tree.intersect_ray(V, F, origins.row(i), dirs.row(i), hit)) {
+            stats.num_hits += 1;
+        }
+    }
+    stats.seconds = igl::get_seconds() - start_time;
+    stats.num_rays = num_rays;
+    stats.rays_per_second = stats.seconds > 0.0 ? num_rays / stats.seconds : 0.0;
+    return stats;
+}
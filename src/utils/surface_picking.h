@@ -0,0 +1,40 @@
+#ifndef SURFACE_PICKING_H
+#define SURFACE_PICKING_H
+
+#include <Eigen/Core>
+#include <igl/AABB.h>
+
+
+typedef igl::AABB<Eigen::MatrixXd, 3> SurfaceTree;
+
+// Cast a ray from the screen position pos through the triangle mesh (V, F) and return the first face hit and the
+// barycentric coordinates of the hit in it. This is igl::unproject_onto_mesh with the ray cast through tree, which
+// must have been built over (V, F), instead of against every triangle.
+bool pick_surface(const SurfaceTree& tree,
+                  const Eigen::MatrixXd& V,
+                  const Eigen::MatrixXi& F,
+                  const Eigen::Vector2f& pos,
+                  const Eigen::Matrix4f& model,
+                  const Eigen::Matrix4f& proj,
+                  const Eigen::Vector4f& viewport,
+                  int& fid,
+                  Eigen::Vector3f& bc);
+
+
+// Summary of a call to benchmark_surface_rays
+struct RayBenchmarkStats {
+    int num_rays = 0;
+    int num_hits = 0;
+    double seconds = 0.0;
+    double rays_per_second = 0.0;
+};
+
+// Time num_rays first-hit queries against tree, which must have been built over (V, F). The rays start on a sphere
+// around the mesh and aim at random triangles, so most of them hit the surface like picking rays do.
+RayBenchmarkStats benchmark_surface_rays(const SurfaceTree& tree,
+                                         const Eigen::MatrixXd& V,
+                                         const Eigen::MatrixXi& F,
+                                         int num_rays,
+                                         unsigned seed = 0);
+
+#endif // SURFACE_PICKING_H
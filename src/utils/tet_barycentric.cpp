@@ -0,0 +1,117 @@
+#include "tet_barycentric.h"
+
+#include <Eigen/LU>
+#include <igl/parallel_for.h>
+
+#include <algorithm>
+#include <limits>
+
+
+constexpr double TetBarycentricTable::DEFAULT_EPSILON;
+constexpr int TetBarycentricTable::LANES;
+constexpr int TetBarycentricTable::COEFFS;
+
+
+void TetBarycentricTable::build(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT) {
+    _num_tets = TT.rows();
+    const int num_blocks = (_num_tets + LANES - 1) / LANES;
+    _coeffs.setConstant(LANES, num_blocks * COEFFS, std::numeric_limits<double>::quiet_NaN());
+
+    igl::parallel_for(_num_tets, [&](const int t) {
+        const Eigen::RowVector3d v0 = TV.row(TT(t, 0));
+        Eigen::Matrix3d E;
+        for (int k = 0; k < 3; k++) {
+            E.col(k) = (TV.row(TT(t, k + 1)) - v0).transpose();
+        }
+
+        Eigen::Matrix3d E_inv;
+        bool invertible;
+        double det;
+        E.computeInverseAndDetWithCheck(E_inv, det, invertible, 0.0);
+        if (!invertible) {
+            return;
+        }
+
+        const int lane = t % LANES;
+        const int column = (t / LANES) * COEFFS;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                _coeffs(lane, column + 3 * i + j) = E_inv(i, j);
+            }
+            _coeffs(lane, column + 9 + i) = v0[i];
+        }
+    }, 1000);
+}
+
+
+void TetBarycentricTable::block_barycentric(const Eigen::RowVector3d& p, const Packet* c, Packet b[4]) {
+    const Packet x = p[0] - c[9], y = p[1] - c[10], z = p[2] - c[11];
+    b[1] = c[0] * x + c[1] * y + c[2] * z;
+    b[2] = c[3] * x + c[4] * y + c[5] * z;
+    b[3] = c[6] * x + c[7] * y + c[8] * z;
+    b[0] = 1.0 - b[1] - b[2] - b[3];
+}
+
+
+void TetBarycentricTable::barycentric(const Eigen::RowVector3d& p, int begin, int end, Eigen::MatrixX4d& B) const {
+    B.resize(end - begin, 4);
+    Packet c[COEFFS], b[4];
+    for (int block = begin / LANES; block * LANES < end; block++) {
+        for (int k = 0; k < COEFFS; k++) {
+            c[k] = _coeffs.col(block * COEFFS + k).array();
+        }
+        block_barycentric(p, c, b);
+
+        const int first = std::max(begin, block * LANES);
+        const int last = std::min(end, (block + 1) * LANES);
+        for (int t = first; t < last; t++) {
+            for (int j = 0; j < 4; j++) {
+                B(t - begin, j) = b[j][t % LANES];
+            }
+        }
+    }
+}
+
+
+void TetBarycentricTable::barycentric(const Eigen::MatrixXd& P, int tet, Eigen::MatrixX4d& B) const {
+    const int lane = tet % LANES;
+    const int column = (tet / LANES) * COEFFS;
+    Eigen::Matrix3d E_inv;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            E_inv(i, j) = _coeffs(lane, column + 3 * i + j);
+        }
+    }
+    const Eigen::RowVector3d v0(_coeffs(lane, column + 9), _coeffs(lane, column + 10), _coeffs(lane, column + 11));
+
+    B.resize(P.rows(), 4);
+    B.rightCols<3>().noalias() = (P.rowwise() - v0) * E_inv.transpose();
+    B.col(0) = Eigen::VectorXd::Ones(P.rows()) - B.rightCols<3>().rowwise().sum();
+}
+
+
+int TetBarycentricTable::first_containing(const Eigen::RowVector3d& p, const int* candidates, int num_candidates,
+                                          Eigen::Vector4d& coords, double epsilon) const {
+    Packet c[COEFFS], b[4];
+    for (int start = 0; start < num_candidates; start += LANES) {
+        // Gather LANES candidates into packets, padding the last block with its first candidate
+        const int n = std::min(LANES, num_candidates - start);
+        for (int i = 0; i < LANES; i++) {
+            const int tet = candidates[start + (i < n ? i : 0)];
+            const double* src = _coeffs.data() + (tet / LANES) * COEFFS * LANES + tet % LANES;
+            for (int k = 0; k < COEFFS; k++) {
+                c[k][i] = src[k * LANES];
+            }
+        }
+        block_barycentric(p, c, b);
+
+        const auto inside = (b[0] >= -epsilon) && (b[1] >= -epsilon) && (b[2] >= -epsilon) && (b[3] >= -epsilon);
+        for (int i = 0; i < n; i++) {
+            if (inside[i]) {
+                coords << b[0][i], b[1][i], b[2][i], b[3][i];
+                return candidates[start + i];
+            }
+        }
+    }
+    return -1;
+}
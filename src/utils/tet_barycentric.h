@@ -0,0 +1,68 @@
+#ifndef TET_BARYCENTRIC_H
+#define TET_BARYCENTRIC_H
+
+#include <Eigen/Core>
+
+
+// Precomputed affine maps from world space to the barycentric coordinates of each tet of a mesh.
+//
+// For a tet (v0, v1, v2, v3) with edge matrix E = [v1 - v0, v2 - v0, v3 - v0], the last three barycentric
+// coordinates of p are E^-1 (p - v0) and the first one is 1 minus their sum. E^-1 and v0 are stored for blocks of
+// LANES consecutive tets, with each coefficient of the block contiguous. A query costs 9 multiply-adds, the kernels
+// over ranges of tets or gathered candidates evaluate a whole block at once with packet operations, and a single
+// tet still only touches a few cache lines. Degenerate tets get NaN coefficients and never contain a point.
+class TetBarycentricTable {
+public:
+    // Barycentric coordinates may be this negative for a point to count as inside a tet
+    static constexpr double DEFAULT_EPSILON = 1e-10;
+
+    void build(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT);
+
+    void clear() { _coeffs.resize(LANES, 0); _num_tets = 0; }
+
+    int num_tets() const { return _num_tets; }
+
+    // Barycentric coordinates of p with respect to tet
+    Eigen::Vector4d barycentric(const Eigen::RowVector3d& p, int tet) const {
+        const double* c = _coeffs.data() + (tet / LANES) * COEFFS * LANES + tet % LANES;
+        const double x = p[0] - c[9 * LANES], y = p[1] - c[10 * LANES], z = p[2] - c[11 * LANES];
+        const double b1 = c[0] * x + c[LANES] * y + c[2 * LANES] * z;
+        const double b2 = c[3 * LANES] * x + c[4 * LANES] * y + c[5 * LANES] * z;
+        const double b3 = c[6 * LANES] * x + c[7 * LANES] * y + c[8 * LANES] * z;
+        return Eigen::Vector4d(1.0 - b1 - b2 - b3, b1, b2, b3);
+    }
+
+    // Return true if p is in tet and set its barycentric coordinates
+    bool contains(const Eigen::RowVector3d& p, int tet, Eigen::Vector4d& coords,
+                  double epsilon = DEFAULT_EPSILON) const {
+        coords = barycentric(p, tet);
+        return (coords.array() >= -epsilon).all();
+    }
+
+    // Barycentric coordinates of p with respect to the tets begin, ..., end - 1. Row i of B is for tet begin + i.
+    void barycentric(const Eigen::RowVector3d& p, int begin, int end, Eigen::MatrixX4d& B) const;
+
+    // Barycentric coordinates of every row of P with respect to tet. Row i of B is for P.row(i).
+    void barycentric(const Eigen::MatrixXd& P, int tet, Eigen::MatrixX4d& B) const;
+
+    // Return the first of the num_candidates tets in candidates which contains p, or -1 if there is none. The
+    // candidates are gathered and tested LANES at a time.
+    int first_containing(const Eigen::RowVector3d& p, const int* candidates, int num_candidates,
+                         Eigen::Vector4d& coords, double epsilon = DEFAULT_EPSILON) const;
+
+private:
+    static constexpr int LANES = 4;
+    static constexpr int COEFFS = 12;
+    typedef Eigen::Array<double, LANES, 1> Packet;
+
+    // Column b * COEFFS + k holds coefficient k of the tets b * LANES, ..., b * LANES + LANES - 1. Coefficients
+    // 0-8 are the row major inverse edge matrix and 9-11 the first vertex of the tet. The last block is padded
+    // with NaN.
+    Eigen::Matrix<double, LANES, Eigen::Dynamic> _coeffs;
+    int _num_tets = 0;
+
+    // Barycentric coordinates of p with respect to the tets of a block given by its COEFFS coefficient packets
+    static void block_barycentric(const Eigen::RowVector3d& p, const Packet* c, Packet b[4]);
+};
+
+#endif // TET_BARYCENTRIC_H
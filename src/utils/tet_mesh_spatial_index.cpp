@@ -0,0 +1,288 @@
+#include "tet_mesh_spatial_index.h"
+#include "tet_mesh_topology.h"
+
+#include <igl/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+
+namespace {
+
+constexpr int KD_LEAF_SIZE = 8;
+constexpr int MAX_WALK_STEPS = 512;
+constexpr int QUERY_CHUNK_SIZE = 1024;
+
+// Slack on the bounds of the grid so points on the boundary of the mesh are found
+constexpr double GRID_EPSILON = 1e-10;
+
+double squared_distance_to_box(const Eigen::RowVector3d& p, const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner) {
+    double d2 = 0.0;
+    for (int i = 0; i < 3; i++) {
+        const double d = std::max({ min_corner[i] - p[i], 0.0, p[i] - max_corner[i] });
+        d2 += d * d;
+    }
+    return d2;
+}
+
+} // namespace
+
+
+void TetMeshSpatialIndex::clear() {
+    _TV.resize(0, 0);
+    _TT.resize(0, 0);
+    _TN.resize(0, 0);
+    _vertex_tets.resize(0);
+    _barycentric.clear();
+    _grid_dims.setZero();
+    _cell_offsets.clear();
+    _cell_tets.clear();
+    _kd_nodes.clear();
+    _kd_vertices.clear();
+}
+
+
+void TetMeshSpatialIndex::build(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT) {
+    clear();
+    _TV = TV;
+    _TT = TT;
+
+    const int num_vertices = TV.rows();
+    const int num_tets = TT.rows();
+
+    TetMeshTopology topology;
+    Eigen::MatrixXi TF;
+    Eigen::VectorXi C;
+    tet_mesh_topology(TT, num_vertices, topology, TF, C);
+    _TN = topology.TN;
+    _barycentric.build(TV, TT);
+
+    // First tet incident to each vertex
+    _vertex_tets.setConstant(num_vertices, -1);
+    for (int t = 0; t < num_tets; t++) {
+        for (int k = 0; k < 4; k++) {
+            if (_vertex_tets[TT(t, k)] < 0) {
+                _vertex_tets[TT(t, k)] = t;
+            }
+        }
+    }
+
+    if (num_vertices > 0) {
+        _kd_vertices.resize(num_vertices);
+        std::iota(_kd_vertices.begin(), _kd_vertices.end(), 0);
+        _kd_nodes.reserve(2 * (num_vertices / KD_LEAF_SIZE + 1));
+        build_kd_tree(0, num_vertices);
+    }
+
+    if (num_tets == 0) {
+        return;
+    }
+
+    // Grid cells are sized to hold about one tet each
+    const Eigen::Vector3d bbox_min = TV.colwise().minCoeff();
+    const Eigen::Vector3d bbox_max = TV.colwise().maxCoeff();
+    const Eigen::Vector3d extent = (bbox_max - bbox_min).cwiseMax(1e-12);
+    _cell_size = std::max(std::cbrt(extent.prod() / num_tets), extent.maxCoeff() / 1024.0);
+    _grid_min = bbox_min;
+    for (int i = 0; i < 3; i++) {
+        _grid_dims[i] = std::max(1, int(std::ceil(extent[i] / _cell_size)));
+    }
+
+    auto cell_range = [&](int t, Eigen::Vector3i& lo, Eigen::Vector3i& hi) {
+        Eigen::Vector3d tmin = TV.row(TT(t, 0)), tmax = TV.row(TT(t, 0));
+        for (int k = 1; k < 4; k++) {
+            tmin = tmin.cwiseMin(TV.row(TT(t, k)).transpose());
+            tmax = tmax.cwiseMax(TV.row(TT(t, k)).transpose());
+        }
+        for (int i = 0; i < 3; i++) {
+            lo[i] = std::min(_grid_dims[i] - 1, std::max(0, int((tmin[i] - _grid_min[i]) / _cell_size)));
+            hi[i] = std::min(_grid_dims[i] - 1, std::max(0, int((tmax[i] - _grid_min[i]) / _cell_size)));
+        }
+    };
+    auto cell_index = [&](int x, int y, int z) { return (z * _grid_dims[1] + y) * _grid_dims[0] + x; };
+
+    const int num_cells = _grid_dims.prod();
+    _cell_offsets.assign(num_cells + 1, 0);
+    Eigen::Vector3i lo, hi;
+    for (int t = 0; t < num_tets; t++) {
+        cell_range(t, lo, hi);
+        for (int z = lo[2]; z <= hi[2]; z++)
+        for (int y = lo[1]; y <= hi[1]; y++)
+        for (int x = lo[0]; x <= hi[0]; x++) {
+            _cell_offsets[cell_index(x, y, z) + 1] += 1;
+        }
+    }
+    for (int c = 0; c < num_cells; c++) {
+        _cell_offsets[c + 1] += _cell_offsets[c];
+    }
+    std::vector<int> cursor(_cell_offsets.begin(), _cell_offsets.end() - 1);
+    _cell_tets.resize(_cell_offsets[num_cells]);
+    for (int t = 0; t < num_tets; t++) {
+        cell_range(t, lo, hi);
+        for (int z = lo[2]; z <= hi[2]; z++)
+        for (int y = lo[1]; y <= hi[1]; y++)
+        for (int x = lo[0]; x <= hi[0]; x++) {
+            _cell_tets[cursor[cell_index(x, y, z)]++] = t;
+        }
+    }
+}
+
+
+int TetMeshSpatialIndex::build_kd_tree(int begin, int end) {
+    const int node_index = _kd_nodes.size();
+    _kd_nodes.emplace_back();
+
+    Eigen::Vector3d min_corner = _TV.row(_kd_vertices[begin]), max_corner = min_corner;
+    for (int i = begin + 1; i < end; i++) {
+        min_corner = min_corner.cwiseMin(_TV.row(_kd_vertices[i]).transpose());
+        max_corner = max_corner.cwiseMax(_TV.row(_kd_vertices[i]).transpose());
+    }
+
+    int left = -1, right = -1;
+    if (end - begin > KD_LEAF_SIZE) {
+        // Split at the median of the widest axis
+        int axis;
+        (max_corner - min_corner).maxCoeff(&axis);
+        const int mid = begin + (end - begin) / 2;
+        std::nth_element(_kd_vertices.begin() + begin, _kd_vertices.begin() + mid, _kd_vertices.begin() + end,
+                         [&](int a, int b) { return _TV(a, axis) < _TV(b, axis); });
+        left = build_kd_tree(begin, mid);
+        right = build_kd_tree(mid, end);
+    }
+
+    KdNode& node = _kd_nodes[node_index];
+    node.min_corner = min_corner;
+    node.max_corner = max_corner;
+    node.begin = begin;
+    node.end = end;
+    node.left = left;
+    node.right = right;
+    return node_index;
+}
+
+
+int TetMeshSpatialIndex::walk(const Eigen::RowVector3d& p, int start, Eigen::Vector4d& barycentric) const {
+    int tet = start;
+    for (int step = 0; step < MAX_WALK_STEPS && tet >= 0; step++) {
+        if (_barycentric.contains(p, tet, barycentric)) {
+            return tet;
+        }
+        // Cross the face opposite the most negative coordinate, TN(t, j) is the tet across from vertex j
+        int j;
+        barycentric.minCoeff(&j);
+        tet = _TN(tet, j);
+    }
+    return -1;
+}
+
+
+bool TetMeshSpatialIndex::cell_of(const Eigen::RowVector3d& p, Eigen::Vector3i& cell) const {
+    for (int i = 0; i < 3; i++) {
+        const double x = (p[i] - _grid_min[i]) / _cell_size;
+        if (x < -GRID_EPSILON || x > _grid_dims[i] + GRID_EPSILON) {
+            return false;
+        }
+        cell[i] = std::min(_grid_dims[i] - 1, std::max(0, int(x)));
+    }
+    return true;
+}
+
+
+int TetMeshSpatialIndex::containing_tet(const Eigen::RowVector3d& p, int hint, Eigen::Vector4d* barycentric) const {
+    if (empty()) {
+        return -1;
+    }
+    Eigen::Vector4d coords;
+    if (hint >= 0 && hint < _TT.rows()) {
+        const int tet = walk(p, hint, coords);
+        if (tet >= 0) {
+            if (barycentric) {
+                *barycentric = coords;
+            }
+            return tet;
+        }
+    }
+
+    Eigen::Vector3i cell;
+    if (!cell_of(p, cell)) {
+        return -1;
+    }
+    const int c = (cell[2] * _grid_dims[1] + cell[1]) * _grid_dims[0] + cell[0];
+    const int tet = _barycentric.first_containing(p, _cell_tets.data() + _cell_offsets[c],
+                                                  _cell_offsets[c + 1] - _cell_offsets[c], coords);
+    if (tet >= 0 && barycentric) {
+        *barycentric = coords;
+    }
+    return tet;
+}
+
+
+void TetMeshSpatialIndex::containing_tets(const Eigen::MatrixXd& P, Eigen::VectorXi& tets) const {
+    Eigen::MatrixX4d barycentric;
+    containing_tets(P, tets, barycentric);
+}
+
+
+void TetMeshSpatialIndex::containing_tets(const Eigen::MatrixXd& P, Eigen::VectorXi& tets,
+                                          Eigen::MatrixX4d& barycentric) const {
+    tets.resize(P.rows());
+    barycentric.resize(P.rows(), 4);
+    const int num_chunks = (P.rows() + QUERY_CHUNK_SIZE - 1) / QUERY_CHUNK_SIZE;
+    igl::parallel_for(num_chunks, [&](const int chunk) {
+        const int end = std::min<int>(P.rows(), (chunk + 1) * QUERY_CHUNK_SIZE);
+        int hint = -1;
+        Eigen::Vector4d coords;
+        for (int i = chunk * QUERY_CHUNK_SIZE; i < end; i++) {
+            tets[i] = containing_tet(P.row(i), hint, &coords);
+            if (tets[i] >= 0) {
+                hint = tets[i];
+                barycentric.row(i) = coords.transpose();
+            }
+        }
+    }, 1);
+}
+
+
+int TetMeshSpatialIndex::nearest_vertex(const Eigen::RowVector3d& p) const {
+    if (_kd_nodes.empty()) {
+        return -1;
+    }
+
+    int best = -1;
+    double best_d2 = std::numeric_limits<double>::infinity();
+    int stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const KdNode& node = _kd_nodes[stack[--stack_size]];
+        if (squared_distance_to_box(p, node.min_corner, node.max_corner) >= best_d2) {
+            continue;
+        }
+        if (node.left < 0) {
+            for (int i = node.begin; i < node.end; i++) {
+                const double d2 = (_TV.row(_kd_vertices[i]) - p).squaredNorm();
+                if (d2 < best_d2 || (d2 == best_d2 && _kd_vertices[i] < best)) {
+                    best_d2 = d2;
+                    best = _kd_vertices[i];
+                }
+            }
+            continue;
+        }
+        // Push the farther child first so the closer one is searched first
+        const KdNode& left = _kd_nodes[node.left];
+        const KdNode& right = _kd_nodes[node.right];
+        const bool left_first = squared_distance_to_box(p, left.min_corner, left.max_corner) <=
+                                squared_distance_to_box(p, right.min_corner, right.max_corner);
+        stack[stack_size++] = left_first ? node.right : node.left;
+        stack[stack_size++] = left_first ? node.left : node.right;
+    }
+    return best;
+}
+
+
+void TetMeshSpatialIndex::nearest_vertices(const Eigen::MatrixXd& P, Eigen::VectorXi& vertices) const {
+    vertices.resize(P.rows());
+    igl::parallel_for(P.rows(), [&](const int i) { vertices[i] = nearest_vertex(P.row(i)); }, 1000);
+}
@@ -0,0 +1,82 @@
+#ifndef TET_MESH_SPATIAL_INDEX_H
+#define TET_MESH_SPATIAL_INDEX_H
+
+#include <Eigen/Core>
+
+#include "tet_barycentric.h"
+
+#include <vector>
+
+
+// Point location and nearest vertex queries on a tet mesh.
+//
+// Tets are binned into a uniform grid over the bounding box of the mesh with about one tet per cell, and
+// vertices are stored in a k-d tree. Point location first walks the face adjacency of the mesh from a hint tet,
+// which is amortized constant time for coherent queries such as points along a curve, and falls back to the grid
+// if the walk leaves the mesh.
+class TetMeshSpatialIndex {
+public:
+    // Build the index. The index keeps its own copy of the mesh.
+    void build(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TT);
+
+    void clear();
+
+    bool empty() const { return _TT.rows() == 0; }
+
+    // Return the index of a tet containing p or -1 if p is in no tet. If hint is a valid tet, the search
+    // walks from it through the face adjacency before falling back to the grid. If barycentric is not null,
+    // it is set to the coordinates of p in the tet found.
+    int containing_tet(const Eigen::RowVector3d& p, int hint = -1, Eigen::Vector4d* barycentric = nullptr) const;
+
+    // Locate each row of P. Queries are split into contiguous chunks processed in parallel, and each query
+    // starts its walk from the previous hit in its chunk, so P should be ordered coherently.
+    void containing_tets(const Eigen::MatrixXd& P, Eigen::VectorXi& tets) const;
+
+    // Same as above, also returning the barycentric coordinates of each point in its tet (undefined if not found)
+    void containing_tets(const Eigen::MatrixXd& P, Eigen::VectorXi& tets, Eigen::MatrixX4d& barycentric) const;
+
+    // Return the index of the vertex closest to p or -1 if the mesh is empty
+    int nearest_vertex(const Eigen::RowVector3d& p) const;
+
+    // Closest vertex to each row of P, computed in parallel
+    void nearest_vertices(const Eigen::MatrixXd& P, Eigen::VectorXi& vertices) const;
+
+    // Return a tet incident to the vertex v or -1 if v is in no tet
+    int vertex_tet(int v) const { return _vertex_tets[v]; }
+
+    // The tets the index was built over, which the tet indices returned by the queries refer to
+    const Eigen::MatrixXi& tets() const { return _TT; }
+
+    const TetBarycentricTable& barycentric_table() const { return _barycentric; }
+
+private:
+    struct KdNode {
+        Eigen::Vector3d min_corner;
+        Eigen::Vector3d max_corner;
+        int begin, end;      // Range of _kd_vertices
+        int left, right;     // Children, -1 for leaves
+    };
+
+    Eigen::MatrixXd _TV;
+    Eigen::MatrixXi _TT;
+    Eigen::MatrixXi _TN;
+    Eigen::VectorXi _vertex_tets;
+    TetBarycentricTable _barycentric;
+
+    // Uniform grid with the tets overlapping each cell stored contiguously
+    Eigen::Vector3d _grid_min;
+    double _cell_size = 1.0;
+    Eigen::Vector3i _grid_dims = Eigen::Vector3i::Zero();
+    std::vector<int> _cell_offsets;
+    std::vector<int> _cell_tets;
+
+    // k-d tree over the vertices, _kd_nodes[0] is the root
+    std::vector<KdNode> _kd_nodes;
+    std::vector<int> _kd_vertices;
+
+    int build_kd_tree(int begin, int end);
+    bool cell_of(const Eigen::RowVector3d& p, Eigen::Vector3i& cell) const;
+    int walk(const Eigen::RowVector3d& p, int start, Eigen::Vector4d& barycentric) const;
+};
+
+#endif // TET_MESH_SPATIAL_INDEX_H
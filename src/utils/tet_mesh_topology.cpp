@@ -0,0 +1,347 @@
+#include "tet_mesh_topology.h"
+
+#include <igl/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+
+namespace {
+
+// Face j of a tet is opposite its j-th vertex, oriented like igl::boundary_facets
+constexpr int TET_FACES[4][3] = { { 1, 3, 2 }, { 0, 2, 3 }, { 0, 3, 1 }, { 0, 1, 2 } };
+
+// Vertex pairs of the six edges of a tet
+constexpr int TET_EDGES[6][2] = { { 0, 1 }, { 0, 2 }, { 0, 3 }, { 1, 2 }, { 1, 3 }, { 2, 3 } };
+
+// Lock free union-find. Roots are always linked under the smaller root so the
+// representative of each set is its smallest element.
+class ConcurrentUnionFind {
+    std::vector<std::atomic<int>> _parent;
+
+public:
+    ConcurrentUnionFind(int n) : _parent(n) {
+        igl::parallel_for(n, [&](const int i) { _parent[i].store(i, std::memory_order_relaxed); }, 10000);
+    }
+
+    int find(int x) {
+        while (true) {
+            int p = _parent[x].load(std::memory_order_relaxed);
+            if (p == x) {
+                return x;
+            }
+            const int gp = _parent[p].load(std::memory_order_relaxed);
+            if (p != gp) {
+                // Path halving, it's fine if another thread got there first
+                _parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+            }
+            x = gp;
+        }
+    }
+
+    void unite(int a, int b) {
+        while (true) {
+            a = find(a);
+            b = find(b);
+            if (a == b) {
+                return;
+            }
+            if (a < b) {
+                std::swap(a, b);
+            }
+            int expected = a;
+            if (_parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+};
+
+struct HalfFace {
+    uint64_t key;  // Packed second and third smallest vertices
+    uint32_t a;    // Smallest vertex
+    int id;        // 4 * tet + local face
+};
+
+// Smallest vertex of a face and a packed key of the other two, sorted
+inline int face_key(const Eigen::MatrixXi& TT, int t, int j, uint64_t& key) {
+    int a = TT(t, TET_FACES[j][0]), b = TT(t, TET_FACES[j][1]), c = TT(t, TET_FACES[j][2]);
+    if (a > b) std::swap(a, b);
+    if (b > c) std::swap(b, c);
+    if (a > b) std::swap(a, b);
+    key = (uint64_t(uint32_t(b)) << 32) | uint64_t(uint32_t(c));
+    return a;
+}
+
+// Match the faces of all tets with a two level radix partition. Faces are scattered into coarse buckets by the
+// high bits of their smallest vertex, each block of tets writing to its own slice of every bucket so no atomics
+// are needed. Each bucket is then sorted by (smallest vertex, packed key) and scanned for duplicates.
+// If TN is not null it is filled with the face adjacency.
+void match_faces(const Eigen::MatrixXi& TT,
+                 int num_vertices,
+                 Eigen::MatrixXi* TN,
+                 std::vector<char>& is_boundary,
+                 int& num_nonmanifold_faces) {
+    const int num_tets = TT.rows();
+
+    constexpr int MAX_BUCKETS = 4096;
+    constexpr int BLOCK_SIZE = 1 << 15;
+    int shift = 0;
+    while ((num_vertices >> shift) >= MAX_BUCKETS) {
+        shift += 1;
+    }
+    const int num_buckets = (num_vertices >> shift) + 1;
+    const int num_blocks = (num_tets + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    // Count the faces of each block in each bucket
+    std::vector<int> block_counts(size_t(num_blocks) * num_buckets, 0);
+    igl::parallel_for(num_blocks, [&](const int block) {
+        int* counts = block_counts.data() + size_t(block) * num_buckets;
+        const int end = std::min(num_tets, (block + 1) * BLOCK_SIZE);
+        for (int t = block * BLOCK_SIZE; t < end; t++) {
+            for (int j = 0; j < 4; j++) {
+                uint64_t key;
+                counts[face_key(TT, t, j, key) >> shift] += 1;
+            }
+        }
+    }, 1);
+
+    // Buckets are contiguous, and within a bucket the slices of the blocks are in block order
+    std::vector<int> bucket_offsets(num_buckets + 1, 0);
+    int offset = 0;
+    for (int b = 0; b < num_buckets; b++) {
+        bucket_offsets[b] = offset;
+        for (int block = 0; block < num_blocks; block++) {
+            int& count = block_counts[size_t(block) * num_buckets + b];
+            const int block_count = count;
+            count = offset;
+            offset += block_count;
+        }
+    }
+    bucket_offsets[num_buckets] = offset;
+
+    // Scatter the faces, each block into its own slices
+    std::vector<HalfFace> half_faces(4 * size_t(num_tets));
+    igl::parallel_for(num_blocks, [&](const int block) {
+        int* cursor = block_counts.data() + size_t(block) * num_buckets;
+        const int end = std::min(num_tets, (block + 1) * BLOCK_SIZE);
+        for (int t = block * BLOCK_SIZE; t < end; t++) {
+            for (int j = 0; j < 4; j++) {
+                uint64_t key;
+                const int a = face_key(TT, t, j, key);
+                half_faces[cursor[a >> shift]++] = HalfFace{ key, uint32_t(a), 4 * t + j };
+            }
+        }
+    }, 1);
+
+    // Match identical faces within each bucket. Every half face lives in exactly one bucket,
+    // so the buckets write to disjoint entries of TN and is_boundary.
+    if (TN) {
+        TN->setConstant(num_tets, 4, -1);
+    }
+    is_boundary.assign(4 * size_t(num_tets), 0);
+    const int num_low_values = 1 << shift;
+    std::vector<int> nonmanifold_per_thread;
+    std::vector<std::vector<HalfFace>> scratch_per_thread;
+    std::vector<std::vector<int>> low_offsets_per_thread;
+    num_nonmanifold_faces = 0;
+    igl::parallel_for(num_buckets,
+        [&](const size_t num_threads) {
+            nonmanifold_per_thread.assign(num_threads, 0);
+            scratch_per_thread.resize(num_threads);
+            low_offsets_per_thread.resize(num_threads);
+        },
+        [&](const int b, const size_t thread_id) {
+            HalfFace* begin = half_faces.data() + bucket_offsets[b];
+            HalfFace* end = half_faces.data() + bucket_offsets[b + 1];
+
+            // Counting sort the bucket by the low bits of the smallest vertex, then sort each vertex by key
+            std::vector<HalfFace>& scratch = scratch_per_thread[thread_id];
+            scratch.assign(begin, end);
+            std::vector<int>& low_offsets = low_offsets_per_thread[thread_id];
+            low_offsets.assign(num_low_values + 1, 0);
+            for (const HalfFace& f : scratch) {
+                low_offsets[(f.a & (num_low_values - 1)) + 1] += 1;
+            }
+            for (int i = 0; i < num_low_values; i++) {
+                low_offsets[i + 1] += low_offsets[i];
+            }
+            for (const HalfFace& f : scratch) {
+                begin[low_offsets[f.a & (num_low_values - 1)]++] = f;
+            }
+            for (HalfFace* vertex_begin = begin; vertex_begin != end;) {
+                HalfFace* vertex_end = vertex_begin + 1;
+                while (vertex_end != end && vertex_end->a == vertex_begin->a) {
+                    ++vertex_end;
+                }
+                std::sort(vertex_begin, vertex_end, [](const HalfFace& f1, const HalfFace& f2) {
+                    return f1.key < f2.key || (f1.key == f2.key && f1.id < f2.id);
+                });
+                vertex_begin = vertex_end;
+            }
+
+            for (HalfFace* run = begin; run != end;) {
+                HalfFace* run_end = run + 1;
+                while (run_end != end && run_end->a == run->a && run_end->key == run->key) {
+                    ++run_end;
+                }
+                const long run_length = run_end - run;
+                if (run_length == 1) {
+                    is_boundary[run->id] = 1;
+                } else if (run_length == 2) {
+                    if (TN) {
+                        (*TN)(run[0].id / 4, run[0].id % 4) = run[1].id / 4;
+                        (*TN)(run[1].id / 4, run[1].id % 4) = run[0].id / 4;
+                    }
+                } else {
+                    nonmanifold_per_thread[thread_id] += 1;
+                }
+                run = run_end;
+            }
+        },
+        [&](const size_t thread_id) { num_nonmanifold_faces += nonmanifold_per_thread[thread_id]; },
+        1);
+}
+
+} // namespace
+
+
+void tet_mesh_topology(const Eigen::MatrixXi& TT,
+                       int num_vertices,
+                       TetMeshTopology& topology,
+                       Eigen::MatrixXi& TF,
+                       Eigen::VectorXi& C) {
+    const int num_tets = TT.rows();
+    topology.clear();
+
+    std::vector<char> is_boundary;
+    match_faces(TT, num_vertices, &topology.TN, is_boundary, topology.num_nonmanifold_faces);
+
+    ConcurrentUnionFind uf(num_vertices);
+    igl::parallel_for(num_tets, [&](const int t) {
+        uf.unite(TT(t, 0), TT(t, 1));
+        uf.unite(TT(t, 0), TT(t, 2));
+        uf.unite(TT(t, 0), TT(t, 3));
+    }, 1000);
+
+    // Gather the boundary in tet order
+    const long num_boundary_faces = std::count(is_boundary.begin(), is_boundary.end(), 1);
+    TF.resize(num_boundary_faces, 3);
+    topology.boundary_tets.resize(num_boundary_faces);
+    topology.boundary_local_faces.resize(num_boundary_faces);
+    int count = 0;
+    for (size_t i = 0; i < is_boundary.size(); i++) {
+        if (is_boundary[i]) {
+            const int t = i / 4, j = i % 4;
+            TF.row(count) = Eigen::RowVector3i(TT(t, TET_FACES[j][0]), TT(t, TET_FACES[j][1]), TT(t, TET_FACES[j][2]));
+            topology.boundary_tets[count] = t;
+            topology.boundary_local_faces[count] = j;
+            count += 1;
+        }
+    }
+
+    // Representatives are the smallest vertex in each component so labelling them in
+    // vertex order numbers the components like igl::components
+    C.resize(num_vertices);
+    std::vector<int> root_label(num_vertices, -1);
+    for (int v = 0; v < num_vertices; v++) {
+        const int root = uf.find(v);
+        if (root_label[root] < 0) {
+            root_label[root] = topology.num_components++;
+        }
+        C[v] = root_label[root];
+    }
+    topology.tet_components.resize(num_tets);
+    igl::parallel_for(num_tets, [&](const int t) { topology.tet_components[t] = C[TT(t, 0)]; }, 10000);
+}
+
+
+void tet_mesh_boundary(const Eigen::MatrixXi& TT, int num_vertices, Eigen::MatrixXi& TF, bool flip) {
+    const int num_tets = TT.rows();
+    std::vector<char> is_boundary;
+    int num_nonmanifold_faces;
+    match_faces(TT, num_vertices, nullptr, is_boundary, num_nonmanifold_faces);
+
+    // Compact the boundary faces in tet order, counting each block of tets before writing it
+    constexpr int BLOCK_SIZE = 1 << 16;
+    const int num_blocks = (num_tets + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<int> block_offsets(num_blocks + 1, 0);
+    igl::parallel_for(num_blocks, [&](const int b) {
+        const size_t begin = 4 * size_t(b) * BLOCK_SIZE;
+        const size_t end = std::min(begin + 4 * size_t(BLOCK_SIZE), is_boundary.size());
+        block_offsets[b + 1] = std::count(is_boundary.begin() + begin, is_boundary.begin() + end, 1);
+    }, 1);
+    for (int b = 0; b < num_blocks; b++) {
+        block_offsets[b + 1] += block_offsets[b];
+    }
+
+    TF.resize(block_offsets[num_blocks], 3);
+    const int c1 = flip ? 2 : 1, c2 = flip ? 1 : 2;
+    igl::parallel_for(num_blocks, [&](const int b) {
+        const size_t begin = 4 * size_t(b) * BLOCK_SIZE;
+        const size_t end = std::min(begin + 4 * size_t(BLOCK_SIZE), is_boundary.size());
+        int count = block_offsets[b];
+        for (size_t i = begin; i < end; i++) {
+            if (is_boundary[i]) {
+                const int t = i / 4, j = i % 4;
+                TF(count, 0) = TT(t, TET_FACES[j][0]);
+                TF(count, c1) = TT(t, TET_FACES[j][1]);
+                TF(count, c2) = TT(t, TET_FACES[j][2]);
+                count += 1;
+            }
+        }
+    }, 1);
+}
+
+
+void tet_mesh_edges(const Eigen::MatrixXi& TT, int num_vertices, Eigen::MatrixXi& E) {
+    const int num_tets = TT.rows();
+
+    // Bucket the larger vertex of every tet edge by the smaller one
+    std::vector<std::atomic<int>> bucket_cursor(num_vertices + 1);
+    for (int i = 0; i <= num_vertices; i++) {
+        bucket_cursor[i].store(0, std::memory_order_relaxed);
+    }
+    igl::parallel_for(num_tets, [&](const int t) {
+        for (int e = 0; e < 6; e++) {
+            const int a = TT(t, TET_EDGES[e][0]), b = TT(t, TET_EDGES[e][1]);
+            bucket_cursor[std::min(a, b)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }, 1000);
+
+    std::vector<int> bucket_offsets(num_vertices + 1, 0);
+    for (int i = 0; i < num_vertices; i++) {
+        bucket_offsets[i + 1] = bucket_offsets[i] + bucket_cursor[i].load(std::memory_order_relaxed);
+        bucket_cursor[i].store(bucket_offsets[i], std::memory_order_relaxed);
+    }
+
+    std::vector<int> buckets(6 * size_t(num_tets));
+    igl::parallel_for(num_tets, [&](const int t) {
+        for (int e = 0; e < 6; e++) {
+            const int a = TT(t, TET_EDGES[e][0]), b = TT(t, TET_EDGES[e][1]);
+            buckets[bucket_cursor[std::min(a, b)].fetch_add(1, std::memory_order_relaxed)] = std::max(a, b);
+        }
+    }, 1000);
+
+    // Deduplicate each bucket in place
+    std::vector<int> num_unique(num_vertices + 1, 0);
+    igl::parallel_for(num_vertices, [&](const int v) {
+        int* begin = buckets.data() + bucket_offsets[v];
+        int* end = buckets.data() + bucket_offsets[v + 1];
+        std::sort(begin, end);
+        num_unique[v + 1] = std::unique(begin, end) - begin;
+    }, 1000);
+    for (int v = 0; v < num_vertices; v++) {
+        num_unique[v + 1] += num_unique[v];
+    }
+
+    E.resize(num_unique[num_vertices], 2);
+    igl::parallel_for(num_vertices, [&](const int v) {
+        for (int i = 0; i < num_unique[v + 1] - num_unique[v]; i++) {
+            E(num_unique[v] + i, 0) = v;
+            E(num_unique[v] + i, 1) = buckets[bucket_offsets[v] + i];
+        }
+    }, 1000);
+}
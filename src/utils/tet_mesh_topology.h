@@ -0,0 +1,57 @@
+#ifndef TET_MESH_TOPOLOGY_H
+#define TET_MESH_TOPOLOGY_H
+
+#include <Eigen/Core>
+
+
+// Connectivity of a tetrahedral mesh which is computed once after meshing and reused by later stages
+struct TetMeshTopology {
+    // TN(i, j) is the tet sharing the face of tet i opposite its j-th vertex,
+    // or -1 if that face is not shared by exactly two tets
+    Eigen::MatrixXi TN;
+
+    // Tet each boundary face belongs to and the local index of that face within the tet
+    Eigen::VectorXi boundary_tets;
+    Eigen::VectorXi boundary_local_faces;
+
+    // Connected component of each tet
+    Eigen::VectorXi tet_components;
+    int num_components = 0;
+
+    // Number of faces shared by more than two tets
+    int num_nonmanifold_faces = 0;
+
+    void clear() {
+        TN.resize(0, 0);
+        boundary_tets.resize(0);
+        boundary_local_faces.resize(0);
+        tet_components.resize(0);
+        num_components = 0;
+        num_nonmanifold_faces = 0;
+    }
+};
+
+
+// Compute face adjacency, boundary faces and connected components of the tet mesh TT in one parallel pass.
+//
+// Faces are radix partitioned by their smallest vertex and matched using a packed key of their two remaining
+// vertices. Components are found with a concurrent union-find over the tets.
+//
+// TF is the boundary of the mesh with the same orientation as igl::boundary_facets and C is the connected
+// component of each of the num_vertices vertices, numbered in the same order as igl::components.
+void tet_mesh_topology(const Eigen::MatrixXi& TT,
+                       int num_vertices,
+                       TetMeshTopology& topology,
+                       Eigen::MatrixXi& TF,
+                       Eigen::VectorXi& C);
+
+
+// Compute the boundary faces of the tet mesh TT, in tet order, with the same face matching as tet_mesh_topology.
+// Faces are oriented like igl::boundary_facets, or the opposite way if flip is true.
+void tet_mesh_boundary(const Eigen::MatrixXi& TT, int num_vertices, Eigen::MatrixXi& TF, bool flip = false);
+
+
+// Compute the unique edges of the tet mesh TT, sorted lexicographically with E(i, 0) < E(i, 1)
+void tet_mesh_edges(const Eigen::MatrixXi& TT, int num_vertices, Eigen::MatrixXi& E);
+
+#endif // TET_MESH_TOPOLOGY_H
@@ -1,9 +1,11 @@
 #include "utils.h"
+#include "tet_mesh_topology.h"
 
 #include <igl/edges.h>
 #include <igl/barycentric_coordinates.h>
 
 #include <array>
+#include <cassert>
 #include <numeric>
 #include <fstream>
 #include <iostream>
@@ -11,91 +13,209 @@
 #include <igl/grad.h>
 #include <igl/adjacency_list.h>
 #include <igl/components.h>
+#include <igl/parallel_for.h>
 
 
-void split_mesh_components(const Eigen::MatrixXi& TT, const Eigen::VectorXi& components, std::vector<Eigen::MatrixXi>& out) {
-  const int num_components = components.maxCoeff() + 1;
+void level_set_centroids(const Eigen::MatrixXd& TV,
+                         const Eigen::MatrixXi& E,
+                         const Eigen::VectorXd& S,
+                         double iso_start,
+                         double iso_step,
+                         int num_isovalues,
+                         Eigen::MatrixXd& centroids,
+                         Eigen::VectorXi& counts) {
+  using namespace Eigen;
 
-  for (int c = 0; c < num_components; c++) {
-    int count = 0;
-    Eigen::MatrixXi TTcomp(TT.rows(), 4);
-    for (int i = 0; i < TT.rows(); i++) {
-      const int t1 = TT(i, 0), t2 = TT(i, 1), t3 = TT(i, 2), t4 = TT(i, 3);
-      const int comp = components[t1];
-      assert(components[t1] == components[t2] && components[t1] == components[t3] && components[t1] == components[t4]);
-      if (!(components[t1] == components[t2] && components[t1] == components[t3] && components[t1] == components[t4])) {
-          std::cerr << "T1: " << components[t1] << " " << components[t2] << " " << components[t3] << " " << components[t4];
-          std::cerr.flush();
-      }
-      if (comp == c) {
-        TTcomp.row(count) = Eigen::RowVector4i(t1, t2, t3, t4);
-        count += 1;
+  const int K = num_isovalues;
+  centroids.setZero(K, 3);
+  counts.setZero(K);
+  if (K <= 0 || iso_step == 0.0) {
+    return;
+  }
+
+  // Edges spanning at most this many level sets are added to each of them directly. Longer edges are added
+  // as p(iso) = a + iso * b to difference arrays, which keeps the pass linear without the cancellation
+  // error that a huge slope b would cause on nearly flat edges.
+  const int max_direct_span = 4;
+
+  const auto isovalue = [&](int k) { return iso_start + k * iso_step; };
+
+  // Per-thread accumulators
+  struct Accumulator {
+    MatrixXd direct_sum;  // K x 3
+    VectorXi direct_count;
+    MatrixXd diff_a;      // (K + 1) x 3
+    MatrixXd diff_b;      // (K + 1) x 3
+    VectorXi diff_count;
+  };
+  std::vector<Accumulator> accumulators;
+
+  const auto prep = [&](const size_t num_threads) {
+    accumulators.resize(num_threads);
+    for (Accumulator& acc : accumulators) {
+      acc.direct_sum.setZero(K, 3);
+      acc.direct_count.setZero(K);
+      acc.diff_a.setZero(K + 1, 3);
+      acc.diff_b.setZero(K + 1, 3);
+      acc.diff_count.setZero(K + 1);
+    }
+  };
+
+  const auto accumulate_edge = [&](const int e, const size_t thread_id) {
+    int v_lo = E(e, 0), v_hi = E(e, 1);
+    if (S[v_lo] > S[v_hi]) {
+      std::swap(v_lo, v_hi);
+    }
+    const double s_lo = S[v_lo], s_hi = S[v_hi];
+    if (s_lo == s_hi) {
+      return;
+    }
+
+    // Level set k contains a vertex on this edge iff s_lo <= iso_k < s_hi (the same test as marching_tets)
+    const auto crosses = [&](int k) { return s_lo <= isovalue(k) && isovalue(k) < s_hi; };
+    double k_lo, k_hi;
+    if (iso_step > 0.0) {
+      k_lo = std::ceil((s_lo - iso_start) / iso_step);
+      k_hi = std::ceil((s_hi - iso_start) / iso_step) - 1.0;
+    } else {
+      k_lo = std::floor((s_hi - iso_start) / iso_step) + 1.0;
+      k_hi = std::floor((s_lo - iso_start) / iso_step);
+    }
+    int k_min = static_cast<int>(std::min(std::max(k_lo, 0.0), double(K)));
+    int k_max = static_cast<int>(std::min(std::max(k_hi, -1.0), double(K - 1)));
+    // Fix up rounding in the divisions above
+    while (k_min > 0 && crosses(k_min - 1)) k_min -= 1;
+    while (k_min <= k_max && !crosses(k_min)) k_min += 1;
+    while (k_max < K - 1 && crosses(k_max + 1)) k_max += 1;
+    while (k_max >= k_min && !crosses(k_max)) k_max -= 1;
+    if (k_min > k_max) {
+      return;
+    }
+
+    Accumulator& acc = accumulators[thread_id];
+    const RowVector3d p_lo = TV.row(v_lo), p_hi = TV.row(v_hi);
+    if (k_max - k_min < max_direct_span) {
+      for (int k = k_min; k <= k_max; k++) {
+        const double w = (isovalue(k) - s_lo) / (s_hi - s_lo);
+        acc.direct_sum.row(k) += (1.0 - w) * p_lo + w * p_hi;
+        acc.direct_count[k] += 1;
       }
+    } else {
+      const RowVector3d b = (p_hi - p_lo) / (s_hi - s_lo);
+      const RowVector3d a = p_lo - s_lo * b;
+      acc.diff_a.row(k_min) += a;
+      acc.diff_a.row(k_max + 1) -= a;
+      acc.diff_b.row(k_min) += b;
+      acc.diff_b.row(k_max + 1) -= b;
+      acc.diff_count[k_min] += 1;
+      acc.diff_count[k_max + 1] -= 1;
+    }
+  };
+
+  MatrixXd direct_sum = MatrixXd::Zero(K, 3), diff_a = MatrixXd::Zero(K + 1, 3), diff_b = MatrixXd::Zero(K + 1, 3);
+  VectorXi direct_count = VectorXi::Zero(K), diff_count = VectorXi::Zero(K + 1);
+  const auto accum = [&](const size_t thread_id) {
+    const Accumulator& acc = accumulators[thread_id];
+    direct_sum += acc.direct_sum;
+    direct_count += acc.direct_count;
+    diff_a += acc.diff_a;
+    diff_b += acc.diff_b;
+    diff_count += acc.diff_count;
+  };
+
+  igl::parallel_for(E.rows(), prep, accumulate_edge, accum, 1000);
+
+  RowVector3d sum_a = RowVector3d::Zero(), sum_b = RowVector3d::Zero();
+  int sum_count = 0;
+  for (int k = 0; k < K; k++) {
+    sum_a += diff_a.row(k);
+    sum_b += diff_b.row(k);
+    sum_count += diff_count[k];
+    counts[k] = direct_count[k] + sum_count;
+    if (counts[k] > 0) {
+      centroids.row(k) = (direct_sum.row(k) + sum_a + isovalue(k) * sum_b) / counts[k];
     }
-    TTcomp.conservativeResize(count, 4);
-    out.push_back(TTcomp);
   }
 }
 
 
-void tet_mesh_faces(const Eigen::MatrixXi& TT, Eigen::MatrixXi& TF, bool flip) {
-  using namespace std;
+void partition_mesh_components(const Eigen::MatrixXi& TT, const Eigen::VectorXi& components,
+                               MeshComponents& out, bool compute_vertex_maps) {
+  const int num_components = components.size() > 0 ? components.maxCoeff() + 1 : 0;
 
-  vector<array<int, 4>> tris_sorted;
+  // Count the tets of each component, then scatter them in order
+  out.tet_offsets.setZero(num_components + 1);
+  for (int i = 0; i < TT.rows(); i++) {
+    const int comp = components[TT(i, 0)];
+    assert(comp == components[TT(i, 1)] && comp == components[TT(i, 2)] && comp == components[TT(i, 3)]);
+    out.tet_offsets[comp + 1] += 1;
+  }
+  for (int c = 0; c < num_components; c++) {
+    out.tet_offsets[c + 1] += out.tet_offsets[c];
+  }
 
-  vector<array<int, 4>> tris;
+  std::vector<int> cursor(out.tet_offsets.data(), out.tet_offsets.data() + num_components);
+  out.TT.resize(TT.rows(), TT.cols());
+  out.tet_indices.resize(TT.rows());
   for (int i = 0; i < TT.rows(); i++) {
-    const int e1 = TT(i, 0);
-    const int e2 = TT(i, 1);
-    const int e3 = TT(i, 2);
-    const int e4 = TT(i, 3);
-    array<int, 4> t1, t2, t3, t4;
-    if (!flip) {
-      t1 = array<int, 4>{{ e1, e2, e3, INT_MAX }};
-      t2 = array<int, 4>{{ e1, e3, e4, INT_MAX }};
-      t3 = array<int, 4>{{ e2, e4, e3, INT_MAX }};
-      t4 = array<int, 4>{{ e1, e4, e2, INT_MAX }};
-    } else {
-      t1 = array<int, 4>{{ e1, e3, e2, INT_MAX }};
-      t2 = array<int, 4>{{ e1, e4, e3, INT_MAX }};
-      t3 = array<int, 4>{{ e2, e3, e4, INT_MAX }};
-      t4 = array<int, 4>{{ e1, e2, e4, INT_MAX }};
-    }
-    tris.push_back(t1);
-    tris.push_back(t2);
-    tris.push_back(t3);
-    tris.push_back(t4);
-    t1[3] = tris_sorted.size();
-    t2[3] = tris_sorted.size()+1;
-    t3[3] = tris_sorted.size()+2;
-    t4[3] = tris_sorted.size()+3;
-    sort(t1.begin(), t1.end());
-    sort(t2.begin(), t2.end());
-    sort(t3.begin(), t3.end());
-    sort(t4.begin(), t4.end());
-    tris_sorted.push_back(t1);
-    tris_sorted.push_back(t2);
-    tris_sorted.push_back(t3);
-    tris_sorted.push_back(t4);
+    const int row = cursor[components[TT(i, 0)]]++;
+    out.TT.row(row) = TT.row(i);
+    out.tet_indices[row] = i;
   }
 
-  int fcount = 0;
-  TF.resize(tris_sorted.size(), 3);
-  sort(tris_sorted.begin(), tris_sorted.end());
-  for (int i = 0; i < TF.rows();) {
-    int v1 = tris_sorted[i][0], v2 = tris_sorted[i][1], v3 = tris_sorted[i][2];
-    int tid = tris_sorted[i][3];
-    int count = 0;
-    while (i < TF.rows() && v1 == tris_sorted[i][0] && v2 == tris_sorted[i][1] && v3 == tris_sorted[i][2]) {
-      i += 1;
-      count += 1;
-    }
-    if (count == 1) {
-      TF.row(fcount++) = Eigen::RowVector3i(tris[tid][0], tris[tid][1], tris[tid][2]);
+  if (!compute_vertex_maps) {
+    out.vertices.resize(0);
+    out.vertex_offsets.resize(0);
+    out.local_indices.resize(0);
+    return;
+  }
+
+  out.vertex_offsets.setZero(num_components + 1);
+  for (int v = 0; v < components.size(); v++) {
+    out.vertex_offsets[components[v] + 1] += 1;
+  }
+  for (int c = 0; c < num_components; c++) {
+    out.vertex_offsets[c + 1] += out.vertex_offsets[c];
+  }
+
+  cursor.assign(out.vertex_offsets.data(), out.vertex_offsets.data() + num_components);
+  out.vertices.resize(components.size());
+  out.local_indices.resize(components.size());
+  for (int v = 0; v < components.size(); v++) {
+    const int c = components[v];
+    out.local_indices[v] = cursor[c] - out.vertex_offsets[c];
+    out.vertices[cursor[c]++] = v;
+  }
+}
+
+
+void MeshComponents::component_mesh(int c, const Eigen::MatrixXd& TV, Eigen::MatrixXd& TVc, Eigen::MatrixXi& TTc) const {
+  TVc.resize(num_vertices(c), TV.cols());
+  for (int i = 0; i < num_vertices(c); i++) {
+    TVc.row(i) = TV.row(vertices[vertex_offsets[c] + i]);
+  }
+
+  const Eigen::Block<const Eigen::MatrixXi> T = tets(c);
+  TTc.resize(T.rows(), T.cols());
+  for (int i = 0; i < T.rows(); i++) {
+    for (int j = 0; j < T.cols(); j++) {
+      TTc(i, j) = local_indices[T(i, j)];
     }
   }
+}
+
+
+void split_mesh_components(const Eigen::MatrixXi& TT, const Eigen::VectorXi& components, std::vector<Eigen::MatrixXi>& out) {
+  MeshComponents partition;
+  partition_mesh_components(TT, components, partition);
+  for (int c = 0; c < partition.num_components(); c++) {
+    out.push_back(partition.tets(c));
+  }
+}
+
 
-  TF.conservativeResize(fcount, 3);
+void tet_mesh_faces(const Eigen::MatrixXi& TT, Eigen::MatrixXi& TF, bool flip) {
+  tet_mesh_boundary(TT, TT.size() > 0 ? TT.maxCoeff() + 1 : 0, TF, flip);
 }
 
 
@@ -189,6 +309,38 @@ bool load_rawfile(const std::string& rawfilename, const Eigen::RowVector3i& dims
     return true;
 }
 
+bool load_rawfile_region(const std::string& rawfilename, const Eigen::RowVector3i& dims,
+                         const Eigen::RowVector3i& region_min, const Eigen::RowVector3i& region_dims,
+                         std::vector<uint8_t> &out, std::shared_ptr<spdlog::logger> logger) {
+    assert("Region must be inside the volume" &&
+           (region_min.array() >= 0).all() && ((region_min + region_dims).array() <= dims.array()).all());
+
+    std::ifstream rawfile(rawfilename, std::ifstream::binary);
+    if (!rawfile.good()) {
+        logger->error("RawFile '{}' does not exist.", rawfilename);
+        return false;
+    }
+
+    // Read the region one row at a time, skipping the parts of the file outside it
+    out.resize((size_t)(region_dims[0]) * (size_t)(region_dims[1]) * (size_t)(region_dims[2]));
+    char* data = reinterpret_cast<char*>(out.data());
+    for (int z = 0; z < region_dims[2]; z++) {
+        for (int y = 0; y < region_dims[1]; y++) {
+            const size_t offset = (size_t)(region_min[0]) +
+                    (size_t)(dims[0]) * ((size_t)(region_min[1] + y) + (size_t)(dims[1]) * (size_t)(region_min[2] + z));
+            rawfile.seekg(offset);
+            rawfile.read(data, region_dims[0]);
+            if (!rawfile) {
+                logger->error("Failed to read region of RawFile '{}' at byte {}.", rawfilename, offset);
+                return false;
+            }
+            data += region_dims[0];
+        }
+    }
+
+    return true;
+}
+
 void edge_endpoints(const Eigen::MatrixXd& V,
                     const Eigen::MatrixXi& F,
                     Eigen::MatrixXd& V1,
@@ -31,9 +31,53 @@ void heat_diffusion_distances(const Eigen::MatrixXd& TV,
                                 Eigen::VectorXd& isovals,
                                 bool normalize);
 
+// Compute the centroids of the level sets S = iso_start + k * iso_step, k = 0, ..., num_isovalues - 1 of the
+// piecewise linear function S on a tet mesh with unique edges E. The level set vertices are the crossings of the
+// edges E just like in igl::marching_tets, but every level set is accumulated in a single parallel pass over E.
+// counts[k] is the number of vertices on the k-th level set, the k-th centroid is undefined if it is zero.
+void level_set_centroids(const Eigen::MatrixXd& TV,
+                         const Eigen::MatrixXi& E,
+                         const Eigen::VectorXd& S,
+                         double iso_start,
+                         double iso_step,
+                         int num_isovalues,
+                         Eigen::MatrixXd& centroids,
+                         Eigen::VectorXi& counts);
+
+// Tets of a mesh grouped by connected component. The tets of component c are the rows tet_offsets[c], ...,
+// tet_offsets[c + 1] - 1 of TT, which is the input mesh with its tets permuted. If vertex maps were requested,
+// vertices holds the vertices of each component in the same way (using vertex_offsets) and local_indices
+// is the index of each mesh vertex within its component.
+struct MeshComponents {
+  Eigen::MatrixXi TT;
+  Eigen::VectorXi tet_offsets;
+  Eigen::VectorXi tet_indices; // Row of each tet in the input mesh
+
+  Eigen::VectorXi vertices;
+  Eigen::VectorXi vertex_offsets;
+  Eigen::VectorXi local_indices;
+
+  int num_components() const { return tet_offsets.size() > 0 ? tet_offsets.size() - 1 : 0; }
+  int num_tets(int c) const { return tet_offsets[c + 1] - tet_offsets[c]; }
+  int num_vertices(int c) const { return vertex_offsets[c + 1] - vertex_offsets[c]; }
+
+  // View of the tets of component c, in the vertex indices of the whole mesh
+  Eigen::Block<const Eigen::MatrixXi> tets(int c) const { return TT.middleRows(tet_offsets[c], num_tets(c)); }
+
+  // Extract component c as a standalone mesh. Requires the vertex maps.
+  void component_mesh(int c, const Eigen::MatrixXd& TV, Eigen::MatrixXd& TVc, Eigen::MatrixXi& TTc) const;
+};
+
+// Group the tets of TT by the component of their vertices with a counting sort, in O(#T + #V) time and memory
+// for any number of components. components is the component of each vertex.
+void partition_mesh_components(const Eigen::MatrixXi& TT, const Eigen::VectorXi& components,
+                               MeshComponents& out, bool compute_vertex_maps = false);
+
+// Copy the tets of each component into its own matrix
 void split_mesh_components(const Eigen::MatrixXi& TT, const Eigen::VectorXi& components, std::vector<Eigen::MatrixXi>& out);
 
 
+// Compute the boundary faces of a tet mesh. See tet_mesh_boundary.
 void tet_mesh_faces(const Eigen::MatrixXi& TT, Eigen::MatrixXi& TF, bool flip=false);
 
 void load_tet_file(const std::string& tet, Eigen::MatrixXd& TV, Eigen::MatrixXi& TF, Eigen::MatrixXi& TT);
@@ -42,6 +86,11 @@ bool load_rawfile(const std::string& rawfilename, const Eigen::RowVector3i& dims
 
 bool load_rawfile(const std::string& rawfilename, const Eigen::RowVector3i& dims, std::vector<uint8_t> &out, std::shared_ptr<spdlog::logger> logger);
 
+// Load the region_dims sized box of voxels starting at region_min from a UINT8 rawfile, without reading the rest of it
+bool load_rawfile_region(const std::string& rawfilename, const Eigen::RowVector3i& dims,
+                         const Eigen::RowVector3i& region_min, const Eigen::RowVector3i& region_dims,
+                         std::vector<uint8_t> &out, std::shared_ptr<spdlog::logger> logger);
+
 void edge_endpoints(const Eigen::MatrixXd& V,
                     const Eigen::MatrixXi& F,
                     Eigen::MatrixXd& V1,